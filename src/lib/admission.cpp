@@ -0,0 +1,242 @@
+/** Admission control: protects the sender service from bursts of queries whose SEAL memory pool
+ *  allocations (hundreds of MB for 16384-degree parameters) would exhaust the host.
+ * */
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#include "admission.h"
+
+using namespace std;
+using namespace seal;
+
+/* Peak pool allocations of a ct-ct multiplication + relinearization, in fresh ciphertexts (k data primes).
+ * The BEHZ multiplication extends both operands to the base q U Bsk (about 2k + 1 primes): ~4 ciphertexts
+ * for the two operands, ~3 for the three polynomials of the tensor product and ~2 for the base conversion
+ * temporaries. Key switching then lifts each of the k RNS components of the third polynomial to k + 1
+ * primes, ~k / 2 ciphertexts, ~3 with the 4-5 data primes of the default 8192 and 16384 parameters.
+ * It is an upper estimate: it is only used to keep the queries in flight under the memory budget. */
+#define MULTIPLY_WORKSPACE_FACTOR 12
+// Retry hint when no query has completed yet
+#define DEFAULT_RETRY_MS 100
+
+
+/**
+ * Estimate the cost of a query from the encryption parameters and the set sizes. Besides its own
+ * ciphertexts and workspace, a query keeps the encoded sender set it reads alive until it completes,
+ * even if the set is dropped from the service meanwhile: its plaintexts are counted too.
+ *
+ * @param params            Encryption parameters of the query
+ * @param sender_size       Number of encoded sender plaintexts (one multiplication each)
+ * @param num_ciphertexts   Number of ciphertexts sent by the receiver
+ *
+ * @return                  Estimated memory and CPU cost
+ * */
+QueryCost estimate_query_cost(EncryptionParameters params, size_t sender_size, size_t num_ciphertexts)
+{
+    QueryCost cost;
+    size_t poly_mod_degree = params.poly_modulus_degree();
+    size_t coeff_mod_count = params.coeff_modulus().size();
+    size_t data_mod_count = coeff_mod_count > 1 ? coeff_mod_count - 1 : 1;     // the last prime is special
+
+    // A fresh ciphertext holds two polynomials with one RNS component per data prime
+    size_t ct_bytes = 2 * poly_mod_degree * data_mod_count * sizeof(uint64_t);
+    cost.memory_bytes = num_ciphertexts * (MULTIPLY_WORKSPACE_FACTOR + 2) * ct_bytes;
+    // A batch-encoded plaintext holds one coefficient per slot
+    cost.memory_bytes += sender_size * poly_mod_degree * sizeof(uint64_t);
+
+    // Multiply and relinearize are quadratic in the number of primes (key switching), linear in the degree
+    double unit_scale = (double)poly_mod_degree * coeff_mod_count * coeff_mod_count / (8192.0 * 5 * 5);
+    cost.cpu_units = (double)num_ciphertexts * max(sender_size, (size_t)1) * unit_scale;
+    return cost;
+}
+
+
+/**
+ * @param budget        Maximum memory and CPU in flight, and length of the waiting list
+ * @param num_workers   Number of queries evaluated in parallel
+ * */
+AdmissionController::AdmissionController(AdmissionBudget budget, size_t num_workers)
+{
+    this->budget = budget;
+    this->num_workers = max(num_workers, (size_t)1);
+}
+
+
+/**
+ * CPU units that can be in flight: the fixed limit of the budget, or the units the workers complete in
+ * `max_delay` at the observed speed (no limit until the first query completes)
+ * */
+double AdmissionController::cpu_limit_locked()
+{
+    if(this->budget.cpu_units > 0)
+        return this->budget.cpu_units;
+    if(this->ms_per_unit == 0)
+        return numeric_limits<double>::infinity();
+    return this->num_workers * this->budget.max_delay.count() / this->ms_per_unit;
+}
+
+
+/** Whether a query can ever be admitted: its cost must fit the memory budget and the fixed CPU limit */
+bool AdmissionController::can_fit_locked(QueryCost cost)
+{
+    return cost.memory_bytes <= this->budget.memory_bytes && 
+        (this->budget.cpu_units == 0 || cost.cpu_units <= this->budget.cpu_units);
+}
+
+
+bool AdmissionController::fits_locked(QueryCost cost)
+{
+    if(this->memory_in_use + cost.memory_bytes > this->budget.memory_bytes)
+        return false;
+    // A query needing more time than `max_delay` on its own is still admitted when nothing else is running
+    return this->in_flight == 0 || this->cpu_in_use + cost.cpu_units <= cpu_limit_locked();
+}
+
+
+/**
+ * Time after which a rejected query has a reasonable chance to be admitted: the work currently
+ * in flight plus the one waiting, at the observed speed
+ * */
+chrono::milliseconds AdmissionController::retry_hint_locked(QueryCost cost)
+{
+    if(this->ms_per_unit == 0)
+        return chrono::milliseconds(DEFAULT_RETRY_MS);
+
+    // The workers evaluate the pending work in parallel
+    double pending_units = this->cpu_in_use + this->waiting * cost.cpu_units;
+    return chrono::milliseconds((long)(pending_units * this->ms_per_unit / this->num_workers) + 1);
+}
+
+
+/**
+ * Decide what to do with a new query
+ *
+ * @param cost  Estimated cost of the query
+ *
+ * @return      admitted (resources are reserved), queued (the caller has to call `admit_waiting` later)
+ *              or rejected, with a retry hint (0 if the query exceeds the budget, so it never fits)
+ * */
+AdmissionDecision AdmissionController::try_admit(QueryCost cost)
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    AdmissionDecision decision;
+    decision.retry_after = chrono::milliseconds(0);
+
+    if(!can_fit_locked(cost))
+        decision.status = AdmissionStatus::rejected;
+    else if(this->waiting == 0 && fits_locked(cost)){
+        this->memory_in_use += cost.memory_bytes;
+        this->cpu_in_use += cost.cpu_units;
+        this->in_flight++;
+        decision.status = AdmissionStatus::admitted;
+    }
+    else if(this->waiting < this->budget.max_waiting){
+        this->waiting++;
+        decision.status = AdmissionStatus::queued;
+    }
+    else{
+        decision.status = AdmissionStatus::rejected;
+        decision.retry_after = retry_hint_locked(cost);
+    }
+    return decision;
+}
+
+
+/**
+ * Try to reserve resources for a query that was queued by `try_admit`
+ *
+ * @param cost  Estimated cost of the query
+ *
+ * @return      true if the query is now admitted
+ * */
+bool AdmissionController::admit_waiting(QueryCost cost)
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    if(!fits_locked(cost))
+        return false;
+
+    this->waiting--;
+    this->memory_in_use += cost.memory_bytes;
+    this->cpu_in_use += cost.cpu_units;
+    this->in_flight++;
+    return true;
+}
+
+
+/**
+ * Undo `admit_waiting`, putting the query back among the waiting ones
+ *
+ * @param cost  Estimated cost of the query
+ * */
+void AdmissionController::return_to_waiting(QueryCost cost)
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    this->in_flight--;
+    this->waiting++;
+    this->memory_in_use -= min(this->memory_in_use, cost.memory_bytes);
+    this->cpu_in_use = (this->in_flight == 0) ? 0 : max(0.0, this->cpu_in_use - cost.cpu_units);
+}
+
+
+/**
+ * Forget a queued query that will never be admitted (e.g. the service is stopping)
+ * */
+void AdmissionController::cancel_waiting()
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    if(this->waiting > 0)
+        this->waiting--;
+}
+
+
+/**
+ * Give back the resources of a completed query
+ *
+ * @param cost      Estimated cost of the query
+ * @param elapsed   Time spent evaluating it, used to refine the retry hints (0 if it never ran)
+ * */
+void AdmissionController::release(QueryCost cost, chrono::duration<double> elapsed)
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    this->in_flight--;
+    this->memory_in_use -= min(this->memory_in_use, cost.memory_bytes);
+    this->cpu_in_use = (this->in_flight == 0) ? 0 : max(0.0, this->cpu_in_use - cost.cpu_units);
+
+    if(cost.cpu_units > 0 && elapsed.count() > 0){
+        double observed = elapsed.count() * 1000 / cost.cpu_units;
+        this->ms_per_unit = (this->ms_per_unit == 0) ? observed : 0.8 * this->ms_per_unit + 0.2 * observed;
+    }
+}
+
+
+chrono::milliseconds AdmissionController::retry_hint(QueryCost cost)
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    return retry_hint_locked(cost);
+}
+
+
+size_t AdmissionController::getMemoryInUse()
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    return this->memory_in_use;
+}
+
+
+double AdmissionController::getCpuInUse()
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    return this->cpu_in_use;
+}
+
+
+double AdmissionController::getCpuLimit()
+{
+    lock_guard<mutex> lock(this->admission_mutex);
+    return cpu_limit_locked();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+#include "seal/seal.h"
+
+using namespace std;
+using namespace seal;
+
+
+/** Estimated resources needed to evaluate one query */
+struct QueryCost
+{
+    size_t memory_bytes = 0;    // peak SEAL memory pool allocations
+    double cpu_units = 0;       // ciphertext-sized work units (one unit ~ one ct-ct multiply + relinearize)
+};
+
+
+/**
+ * Limits enforced by the admission controller on the queries in flight. The cost of a query grows with
+ * the sender dataset, so by default the CPU limit is not a fixed number of units but the work that the
+ * workers complete within `max_delay`, at the evaluation speed observed so far.
+ * */
+struct AdmissionBudget
+{
+    size_t memory_bytes = 2UL << 30;
+    double cpu_units = 0;       // fixed CPU limit, 0 to derive it from the workers and `max_delay`
+    chrono::milliseconds max_delay = chrono::milliseconds(2000);
+    size_t max_waiting = 64;    // queries that can wait for resources before new ones get rejected
+};
+
+
+enum class AdmissionStatus { admitted, queued, rejected };
+
+
+/** Outcome of an admission request; `retry_after` is a hint for rejected queries */
+struct AdmissionDecision
+{
+    AdmissionStatus status;
+    chrono::milliseconds retry_after;
+};
+
+
+/**
+ * Admission control for the sender service: queries are admitted only while the sum of their
+ * estimated costs stays within the budget. The others wait (up to `max_waiting`) or are rejected with
+ * a retry hint, derived from the observed time needed to complete a unit of work. Queries whose cost
+ * alone exceeds the memory budget or the fixed CPU limit are rejected without a hint.
+ * */
+class AdmissionController
+{
+    public:
+        AdmissionController(AdmissionBudget budget, size_t num_workers = 1);
+
+        AdmissionDecision try_admit(QueryCost cost);
+        bool admit_waiting(QueryCost cost);
+        void return_to_waiting(QueryCost cost);
+        void cancel_waiting();
+        void release(QueryCost cost, chrono::duration<double> elapsed);
+        chrono::milliseconds retry_hint(QueryCost cost);
+
+        AdmissionBudget getBudget(){ return this->budget; }
+        size_t getMemoryInUse();
+        double getCpuInUse();
+        double getCpuLimit();
+
+    private:
+        bool can_fit_locked(QueryCost cost);
+        bool fits_locked(QueryCost cost);
+        double cpu_limit_locked();
+        chrono::milliseconds retry_hint_locked(QueryCost cost);
+
+        AdmissionBudget budget;
+        size_t num_workers;                 // queries evaluated in parallel
+        mutex admission_mutex;
+        size_t memory_in_use = 0;
+        double cpu_in_use = 0;
+        size_t in_flight = 0;
+        size_t waiting = 0;
+        double ms_per_unit = 0;             // moving average of the observed evaluation speed
+};
+
+
+QueryCost estimate_query_cost(EncryptionParameters params, size_t sender_size, size_t num_ciphertexts);
@@ -0,0 +1,72 @@
+/** Asynchronous PSI API: the blocking protocol steps wrapped in coroutines (see `task.h`) that run on a
+ *  shared thread pool. A process can keep any number of queries in flight, each one suspended while it
+ *  waits for a worker, with no thread of its own: the workers only ever run steps that are ready.
+ *  The transport has no awaitable operations: exchanging the messages of a query still blocks a thread.
+ * */
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "seal/seal.h"
+#include "async_psi.h"
+#include "receiver.h"
+#include "sender.h"
+
+using namespace std;
+using namespace seal;
+
+
+/**
+ * Same as `crypt_dataset`, as a task running on `pool`
+ * */
+Task<Ciphertext> crypt_dataset_async(ThreadPool &pool, const Receiver &recv, size_t poly_mod_degree)
+{
+    co_await schedule(pool);
+    co_return crypt_dataset(recv, poly_mod_degree);
+}
+
+
+/**
+ * Same as `homomorphic_computation`, as a task running on `pool`
+ * */
+Task<Ciphertext> homomorphic_computation_async(ThreadPool &pool, Ciphertext recv_ct, size_t poly_mod_degree,
+        const vector<uint64_t> &sender_dataset, const RelinKeys &relin_keys)
+{
+    co_await schedule(pool);
+    co_return homomorphic_computation(move(recv_ct), poly_mod_degree, sender_dataset, relin_keys);
+}
+
+
+/**
+ * Same as `decrypt_and_intersect`, as a task running on `pool`
+ * */
+Task<ComputationResult> decrypt_and_intersect_async(ThreadPool &pool, size_t poly_mod_degree,
+        Ciphertext sender_computation, const Receiver &recv)
+{
+    co_await schedule(pool);
+    co_return decrypt_and_intersect(poly_mod_degree, move(sender_computation), recv);
+}
+
+
+/**
+ * The whole scheme for a sender and a receiver living in the same process: encryption, homomorphic
+ * computation and decryption, chained without blocking any thread between the steps
+ *
+ * @param pool              Threads running the steps
+ * @param recv              Receiver, holding its keys and dataset
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param sender_dataset    Sender values
+ *
+ * @return                  Task holding the result of the computation
+ * */
+Task<ComputationResult> compute_intersection_async(ThreadPool &pool, const Receiver &recv, size_t poly_mod_degree,
+        const vector<uint64_t> &sender_dataset)
+{
+    Ciphertext recv_ct = co_await crypt_dataset_async(pool, recv, poly_mod_degree);
+    Ciphertext sender_computation = co_await homomorphic_computation_async(pool, move(recv_ct), poly_mod_degree,
+            sender_dataset, recv.getRelinKeys());
+    co_return co_await decrypt_and_intersect_async(pool, poly_mod_degree, move(sender_computation), recv);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "seal/seal.h"
+#include "hashing.h"
+#include "task.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+using namespace std;
+using namespace seal;
+
+
+/* Coroutine versions of the protocol computation steps: each of them moves to a worker of `pool` before
+ * doing any work and completes there, so the caller's thread is free while the step runs. Arguments
+ * taken by reference must outlive the task. There are no coroutine versions of the message exchange:
+ * the `Transport` operations block, so they are called outside of the tasks. */
+Task<Ciphertext> crypt_dataset_async(ThreadPool &pool, const Receiver &recv, size_t poly_mod_degree);
+Task<Ciphertext> homomorphic_computation_async(ThreadPool &pool, Ciphertext recv_ct, size_t poly_mod_degree, 
+        const vector<uint64_t> &sender_dataset, const RelinKeys &relin_keys);
+Task<ComputationResult> decrypt_and_intersect_async(ThreadPool &pool, size_t poly_mod_degree, 
+        Ciphertext sender_computation, const Receiver &recv);
+Task<ComputationResult> compute_intersection_async(ThreadPool &pool, const Receiver &recv, size_t poly_mod_degree,
+        const vector<uint64_t> &sender_dataset);
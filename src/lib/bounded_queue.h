@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * Bounded multi-producer / multi-consumer lock-free queue (array of sequenced cells, as described by
+ * D. Vyukov). Capacity is rounded up to a power of two; `try_push` fails when the queue is full and
+ * `try_pop` fails when it is empty, so callers decide how to wait.
+ * */
+template <typename T>
+class BoundedQueue
+{
+    public:
+        BoundedQueue(size_t capacity)
+        {
+            size_t size = 2;
+            while(size < capacity)
+                size <<= 1;
+            this->mask = size - 1;
+            this->cells = vector<Cell>(size);
+            for(size_t index = 0; index < size; index++)
+                this->cells[index].sequence.store(index, memory_order_relaxed);
+            this->enqueue_pos.store(0, memory_order_relaxed);
+            this->dequeue_pos.store(0, memory_order_relaxed);
+        }
+
+        bool try_push(T value)
+        {
+            size_t pos = this->enqueue_pos.load(memory_order_relaxed);
+            while(true){
+                Cell &cell = this->cells[pos & this->mask];
+                size_t sequence = cell.sequence.load(memory_order_acquire);
+                long diff = (long)sequence - (long)pos;
+                if(diff == 0){
+                    if(this->enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                        cell.value = move(value);
+                        cell.sequence.store(pos + 1, memory_order_release);
+                        return true;
+                    }
+                }
+                else if(diff < 0)
+                    return false;                           // full
+                else
+                    pos = this->enqueue_pos.load(memory_order_relaxed);
+            }
+        }
+
+        bool try_pop(T &value)
+        {
+            size_t pos = this->dequeue_pos.load(memory_order_relaxed);
+            while(true){
+                Cell &cell = this->cells[pos & this->mask];
+                size_t sequence = cell.sequence.load(memory_order_acquire);
+                long diff = (long)sequence - (long)(pos + 1);
+                if(diff == 0){
+                    if(this->dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                        value = move(cell.value);
+                        cell.sequence.store(pos + this->mask + 1, memory_order_release);
+                        return true;
+                    }
+                }
+                else if(diff < 0)
+                    return false;                           // empty
+                else
+                    pos = this->dequeue_pos.load(memory_order_relaxed);
+            }
+        }
+
+        size_t capacity(){ return this->mask + 1; }
+
+    private:
+        struct Cell
+        {
+            atomic<size_t> sequence;
+            T value;
+
+            Cell() {}
+            Cell(const Cell &other) : sequence(other.sequence.load()), value(other.value) {}
+        };
+
+        vector<Cell> cells;
+        size_t mask;
+        alignas(64) atomic<size_t> enqueue_pos;
+        alignas(64) atomic<size_t> dequeue_pos;
+};
@@ -0,0 +1,237 @@
+/** Streaming dataset reader: the file is read through a fixed-size buffer and returned in chunks,
+ *  so that the receiver can encrypt (and send) a chunk while the next one is read, and the sender
+ *  can encode its dataset incrementally.
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chunk_reader.h"
+#include "file_store.h"
+#include "ingest.h"
+#include "packed_dataset.h"
+
+#define AUDIT
+
+static const size_t MIN_BUFFER_SIZE = 4096;
+static const size_t MAX_LINE_LENGTH = 64;          // longer lines are truncated, as in `read_dataset_from_file`
+
+
+DatasetChunkReader::~DatasetChunkReader()
+{
+    close();
+}
+
+
+void DatasetChunkReader::close()
+{
+    if(this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+}
+
+
+/**
+ * Open a dataset for streaming
+ *
+ * @param path          Dataset path (bitstring CSV or packed binary format)
+ * @param chunk_size    Maximum number of items of each chunk
+ * @param buffer_size   Size of the read buffer (bytes)
+ *
+ * @return              true on success
+ * */
+bool DatasetChunkReader::open(string path, size_t chunk_size, size_t buffer_size)
+{
+    close();
+    this->fd = ::open(path.c_str(), O_RDONLY);
+    if(this->fd < 0 || chunk_size == 0){
+#ifdef AUDIT
+        cout << "cannot open file with path: " << path << endl;
+#endif
+        this->error = true;
+        return false;
+    }
+
+    this->chunk_size = chunk_size;
+    this->buffer.assign(max(buffer_size, MIN_BUFFER_SIZE), 0);
+    this->buffer_begin = this->buffer_end = 0;
+    this->eof = this->error = this->skip_line = false;
+    this->items_read = 0;
+    this->sigma = 0;
+    refill();
+
+    // Detect the packed format by its magic number, then validate the header as `load_packed_dataset` does
+    const unsigned char *data = (const unsigned char *)this->buffer.data();
+    this->packed = this->buffer_end >= sizeof(PackedDatasetHeader) && get_le(data, 0, 4) == PACKED_DATASET_MAGIC;
+    if(this->packed){
+        struct stat st;
+        PackedDatasetHeader header;
+        if(fstat(this->fd, &st) != 0 || !parse_packed_header(data, st.st_size, header)){
+#ifdef AUDIT
+            printf("packed dataset: invalid header in %s\n", path.c_str());
+#endif
+            this->error = true;
+            return false;
+        }
+        this->packed_remaining = header.count;
+        this->packed_item_bytes = header.item_bytes;
+        this->sigma = header.item_bits;
+        this->buffer_begin = sizeof(PackedDatasetHeader);
+    }
+    return true;
+}
+
+
+/**
+ * Move the unread bytes to the front of the buffer and fill the rest from the file
+ *
+ * @return  true if new bytes were read
+ * */
+bool DatasetChunkReader::refill()
+{
+    if(this->eof)
+        return false;
+
+    size_t unread = this->buffer_end - this->buffer_begin;
+    memmove(this->buffer.data(), this->buffer.data() + this->buffer_begin, unread);
+    this->buffer_begin = 0;
+    this->buffer_end = unread;
+
+    size_t read_bytes = 0;
+    while(this->buffer_end < this->buffer.size()){
+        ssize_t count = read(this->fd, this->buffer.data() + this->buffer_end, this->buffer.size() - this->buffer_end);
+        if(count <= 0){
+            this->eof = true;
+            this->error = this->error || count < 0;
+            break;
+        }
+        this->buffer_end += count;
+        read_bytes += count;
+    }
+    return read_bytes > 0;
+}
+
+
+void DatasetChunkReader::next_csv_chunk(vector<uint64_t> &values, ItemStore &items)
+{
+    while(values.size() < this->chunk_size){
+        if(this->buffer_begin == this->buffer_end && !refill())
+            break;
+
+        const char *pos = this->buffer.data() + this->buffer_begin;
+        const char *end = this->buffer.data() + this->buffer_end;
+        const char *line_end = find_newline(pos, end);
+
+        if(this->skip_line){
+            this->buffer_begin = (line_end == end) ? this->buffer_end : line_end - this->buffer.data() + 1;
+            this->skip_line = (line_end == end);
+            continue;
+        }
+
+        // Incomplete line: read more, unless the buffer is already full of it
+        bool truncated = false;
+        if(line_end == end && !this->eof){
+            if(this->buffer_begin > 0 || this->buffer_end < this->buffer.size()){
+                refill();
+                continue;
+            }
+            truncated = true;
+        }
+
+        size_t length = min(MAX_LINE_LENGTH, (size_t)(line_end - pos));
+        uint64_t value;
+        if(pack_bitstring(pos, end, length, value) == 0){
+            printf("An error occurred: the dataset passed is not in a valid format. Only bitstring are accepted\n");
+            this->error = true;
+            return;
+        }
+        if(this->sigma == 0)
+            this->sigma = length;
+        values.push_back(value);
+        items.push_back(pos, length);
+
+        if(truncated){
+            this->buffer_begin = this->buffer_end;
+            this->skip_line = true;
+        }
+        else
+            this->buffer_begin = min(this->buffer_end, (size_t)(line_end - this->buffer.data()) + 1);
+    }
+}
+
+
+void DatasetChunkReader::next_packed_chunk(vector<uint64_t> &values, ItemStore &items)
+{
+    size_t count = min((uint64_t)this->chunk_size, this->packed_remaining);
+    string bitstring(this->sigma, '0');
+
+    while(values.size() < count){
+        if(this->buffer_end - this->buffer_begin < this->packed_item_bytes && !refill()){
+#ifdef AUDIT
+            printf("packed dataset: file is truncated\n");
+#endif
+            this->error = true;
+            return;
+        }
+
+        const unsigned char *data = (const unsigned char *)this->buffer.data();
+        while(values.size() < count && this->buffer_end - this->buffer_begin >= this->packed_item_bytes){
+            uint64_t value = get_le(data, this->buffer_begin, this->packed_item_bytes);
+            this->buffer_begin += this->packed_item_bytes;
+            if(this->sigma < 64 && (value >> this->sigma) != 0){
+#ifdef AUDIT
+                printf("packed dataset: items wider than %ld bits\n", this->sigma);
+#endif
+                this->error = true;
+                return;
+            }
+
+            for(long bit = 0; bit < this->sigma; bit++)
+                bitstring[bit] = '0' + ((value >> (this->sigma - 1 - bit)) & 1);
+            values.push_back(value);
+            items.push_back(bitstring);
+        }
+    }
+    this->packed_remaining -= count;
+}
+
+
+/**
+ * Read the next chunk of the dataset
+ *
+ * @param chunk     Output, the items of the chunk (integer and string representation)
+ *
+ * @return          false when the dataset is over or an error occurred (see `failed`)
+ * */
+bool DatasetChunkReader::next_chunk(Dataset &chunk)
+{
+    if(this->fd < 0 || this->error)
+        return false;
+
+    vector<uint64_t> values;
+    ItemStore items;
+    values.reserve(this->chunk_size);
+
+    // Items read before an invalid line are still returned, as `bitstring_to_long_dataset` does
+    if(this->packed)
+        next_packed_chunk(values, items);
+    else
+        next_csv_chunk(values, items);
+    if(values.size() == 0)
+        return false;
+
+    this->items_read += values.size();
+    chunk.setSigmaLength(this->sigma);
+    chunk.setLongDataset(move(values));
+    chunk.setItemStore(move(items));
+    return true;
+}
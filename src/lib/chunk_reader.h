@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+
+/**
+ * Streaming reader that yields a dataset in chunks of at most `chunk_size` items (typically the slot
+ * count of the scheme), reading the file through a fixed-size buffer: memory stays bounded regardless
+ * of the file size. Both bitstring CSV files and packed binary files are supported.
+ * */
+class DatasetChunkReader
+{
+    public:
+        ~DatasetChunkReader();
+
+        bool open(string path, size_t chunk_size, size_t buffer_size = 1 << 20);
+        bool next_chunk(Dataset &chunk);
+        void close();
+
+        size_t getItemsRead(){ return this->items_read; }
+        long getSigmaLength(){ return this->sigma; }
+        bool failed(){ return this->error; }
+
+    private:
+        bool refill();
+        void next_csv_chunk(vector<uint64_t> &values, ItemStore &items);
+        void next_packed_chunk(vector<uint64_t> &values, ItemStore &items);
+
+        int fd = -1;
+        bool packed = false;
+        bool eof = false;
+        bool error = false;
+        bool skip_line = false;             // the rest of a line longer than the buffer has to be dropped
+        size_t chunk_size = 0;
+        size_t items_read = 0;
+        long sigma = 0;
+
+        vector<char> buffer;
+        size_t buffer_begin = 0;            // first unread byte
+        size_t buffer_end = 0;              // end of the valid bytes
+
+        uint64_t packed_remaining = 0;      // items left in a packed file
+        uint32_t packed_item_bytes = 0;
+};
@@ -0,0 +1,153 @@
+/** Deduplication of the datasets before encryption: a duplicated sender item adds a redundant factor 
+ *  (c - s_j) to the polynomial, i.e. one more multiplication, relinearization and level of depth, and a 
+ *  duplicated receiver item wastes a slot.
+ *  The values are partitioned by hash into buckets with a parallel counting scatter, then every bucket
+ *  is sorted and scanned by one thread: the first occurrence of each value is kept, so the order of 
+ *  the dataset (and the match with its strings) is preserved.
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "dedup.h"
+#include "hashing.h"
+#include "parallel.h"
+
+static const size_t MIN_ITEMS_PER_THREAD = 1 << 16;
+static const size_t BUCKETS_PER_THREAD = 8;
+static const size_t ITEMS_PER_BUCKET = 4096;
+static const unsigned MAX_LOG_BUCKETS = 16;
+
+
+/**
+ * Find the first occurrence of every value
+ *
+ * @param values        Values to deduplicate
+ * @param num_threads   Threads used (0 = one per core), fewer are used on small inputs
+ *
+ * @return              keep[i] = 1 if values[i] does not appear before position i
+ * */
+vector<char> mark_first_occurrences(const vector<uint64_t> &values, size_t num_threads)
+{
+    size_t num_items = values.size();
+    vector<char> keep(num_items, 0);
+    if(num_items == 0)
+        return keep;
+
+    num_threads = choose_threads(num_items, MIN_ITEMS_PER_THREAD, num_threads);
+    // Enough buckets to balance the threads and to sort each of them in cache
+    unsigned log_buckets = 4;
+    while(log_buckets < MAX_LOG_BUCKETS && ((1UL << log_buckets) < num_threads * BUCKETS_PER_THREAD || 
+            num_items >> log_buckets > ITEMS_PER_BUCKET))
+        log_buckets++;
+    size_t num_buckets = 1UL << log_buckets;
+    auto bucket_of = [log_buckets](uint64_t value){ return mix64(value) >> (64 - log_buckets); };
+    auto range_begin = [num_items, num_threads](size_t t){ return num_items * t / num_threads; };
+
+    // Count the values of each bucket in the range of each thread
+    vector<vector<size_t>> position(num_threads, vector<size_t>(num_buckets, 0));
+    run_on_threads(num_threads, [&](size_t t){
+        for(size_t index = range_begin(t); index < range_begin(t + 1); index++)
+            position[t][bucket_of(values[index])]++;
+    });
+
+    // Bucket b holds the values of thread 0, then thread 1, ...: entries stay in index order
+    vector<size_t> bucket_begin(num_buckets + 1, 0);
+    size_t offset = 0;
+    for(size_t b = 0; b < num_buckets; b++){
+        bucket_begin[b] = offset;
+        for(size_t t = 0; t < num_threads; t++){
+            size_t count = position[t][b];
+            position[t][b] = offset;
+            offset += count;
+        }
+    }
+    bucket_begin[num_buckets] = offset;
+
+    vector<pair<uint64_t, uint64_t>> entries(num_items);       // (value, index)
+    run_on_threads(num_threads, [&](size_t t){
+        for(size_t index = range_begin(t); index < range_begin(t + 1); index++)
+            entries[position[t][bucket_of(values[index])]++] = make_pair(values[index], index);
+    });
+
+    // Sort each bucket by (value, index): the first entry of each run is the first occurrence
+    run_on_threads(num_threads, [&](size_t t){
+        for(size_t b = t; b < num_buckets; b += num_threads){
+            auto begin = entries.begin() + bucket_begin[b];
+            auto end = entries.begin() + bucket_begin[b + 1];
+            sort(begin, end);
+            for(auto it = begin; it != end; it++)
+                if(it == begin || it->first != (it - 1)->first)
+                    keep[it->second] = 1;
+        }
+    });
+    return keep;
+}
+
+
+/**
+ * Remove the duplicated values, keeping the first occurrence of each of them in its position
+ *
+ * @param values        Values to deduplicate, modified in place
+ * @param num_threads   Threads used (0 = one per core)
+ *
+ * @return              Input and output counts
+ * */
+DedupStats dedup_values(vector<uint64_t> &values, size_t num_threads)
+{
+    DedupStats stats;
+    stats.input_items = values.size();
+
+    vector<char> keep = mark_first_occurrences(values, num_threads);
+    size_t out = 0;
+    for(size_t index = 0; index < values.size(); index++)
+        if(keep[index])
+            values[out++] = values[index];
+    values.resize(out);
+
+    stats.unique_items = out;
+    stats.duplicates = stats.input_items - out;
+    return stats;
+}
+
+
+/**
+ * Remove the duplicated items of a dataset, from both its integer and string representations
+ *
+ * @param dataset       Dataset to deduplicate, modified in place
+ * @param num_threads   Threads used (0 = one per core)
+ *
+ * @return              Input and output counts
+ * */
+DedupStats dedup_dataset(Dataset &dataset, size_t num_threads)
+{
+    DedupStats stats;
+    const vector<uint64_t> &values = dataset.getLongDatasetRef();
+    const ItemStore &items = dataset.getItemStore();
+    stats.input_items = values.size();
+
+    vector<char> keep = mark_first_occurrences(values, num_threads);
+    bool with_strings = items.size() == values.size();
+    vector<uint64_t> unique_values;
+    ItemStore unique_items;
+    for(size_t index = 0; index < values.size(); index++){
+        if(!keep[index])
+            continue;
+        unique_values.push_back(values[index]);
+        if(with_strings)
+            unique_items.push_back(items.getItem(index));
+    }
+
+    stats.unique_items = unique_values.size();
+    stats.duplicates = stats.input_items - stats.unique_items;
+    if(stats.duplicates > 0){
+        dataset.setLongDataset(move(unique_values));
+        if(with_strings)
+            dataset.setItemStore(move(unique_items));
+    }
+    return stats;
+}
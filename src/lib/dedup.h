@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+
+/** Counts reported by the deduplication */
+struct DedupStats
+{
+    size_t input_items = 0;
+    size_t unique_items = 0;
+    size_t duplicates = 0;
+};
+
+
+vector<char> mark_first_occurrences(const vector<uint64_t> &values, size_t num_threads = 0);
+DedupStats dedup_values(vector<uint64_t> &values, size_t num_threads = 0);
+DedupStats dedup_dataset(Dataset &dataset, size_t num_threads = 0);
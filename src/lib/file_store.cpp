@@ -0,0 +1,201 @@
+/** Files of the library (receiver keys, query and plaintext caches): atomic and durable writes, and the
+ *  little-endian header fields they share. A file is written under a temporary name, flushed with fsync
+ *  and renamed over its final path, then the directory is flushed so that the rename survives a crash:
+ *  a concurrent reader, or a process restarted after a crash, never sees a partial file.
+ * */
+
+
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "file_store.h"
+
+using namespace std;
+
+#define FILE_STORE_AUDIT
+
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    discard();
+}
+
+
+/**
+ * Create a temporary file next to `path`, with a unique name (several processes can save the same path
+ * at once: each one writes its own file, and the last rename wins)
+ *
+ * @param path  Final path of the file
+ *
+ * @return      true on success
+ * */
+bool AtomicFileWriter::open(string path)
+{
+    discard();
+    this->path = path;
+    vector<char> tmp_name(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    tmp_name.insert(tmp_name.end(), suffix, suffix + sizeof(suffix));
+    this->fd = mkostemp(tmp_name.data(), O_CLOEXEC);      // created with mode 0600
+    this->tmp_path = tmp_name.data();
+    if(this->fd < 0){
+#ifdef FILE_STORE_AUDIT
+        cout << "cannot open file with path: " << this->tmp_path << endl;
+#endif
+        return false;
+    }
+    this->ok = true;
+    return true;
+}
+
+
+/**
+ * Append bytes to the file. After a failure the following writes and `commit` fail too.
+ *
+ * @return  true on success
+ * */
+bool AtomicFileWriter::write(const void *data, size_t size)
+{
+    size_t written = 0;
+    while(this->ok && written < size){
+        ssize_t count = ::write(this->fd, (const char *)data + written, size - written);
+        if(count <= 0)
+            this->ok = false;
+        else
+            written += count;
+    }
+    return this->ok;
+}
+
+
+/**
+ * Flush the file to disk and rename it over its final path
+ *
+ * @return  true on success, false if a write failed (the temporary file is then removed)
+ * */
+bool AtomicFileWriter::commit()
+{
+    if(this->fd < 0)
+        return false;
+    bool ok = this->ok && fsync(this->fd) == 0;
+    ok = (::close(this->fd) == 0) && ok;
+    this->fd = -1;
+    if(!ok || rename(this->tmp_path.c_str(), this->path.c_str()) != 0){
+        unlink(this->tmp_path.c_str());
+        return false;
+    }
+
+    // The rename is only durable once the directory is flushed
+    size_t slash = this->path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : this->path.substr(0, slash));
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd >= 0){
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return true;
+}
+
+
+void AtomicFileWriter::discard()
+{
+    if(this->fd >= 0){
+        ::close(this->fd);
+        unlink(this->tmp_path.c_str());
+    }
+    this->fd = -1;
+    this->ok = false;
+}
+
+
+/**
+ * Write a value on `bytes` bytes, little-endian, and advance `out`
+ * */
+void put_le(unsigned char *&out, uint64_t value, size_t bytes)
+{
+    for(size_t b = 0; b < bytes; b++)
+        *out++ = (value >> (8 * b)) & 0xFF;
+}
+
+
+/**
+ * Read a little-endian value of `bytes` bytes at `data + offset`
+ * */
+uint64_t get_le(const unsigned char *data, size_t offset, size_t bytes)
+{
+    uint64_t value = 0;
+    for(size_t b = 0; b < bytes; b++)
+        value |= (uint64_t)data[offset + b] << (8 * b);
+    return value;
+}
+
+
+/**
+ * Write the fields of `FileHeaderPrefix` and advance `out`
+ * */
+void put_header_prefix(unsigned char *&out, uint32_t magic, uint16_t version, uint64_t word,
+        const parms_id_type &parms_hash)
+{
+    put_le(out, magic, 4);
+    put_le(out, version, 2);
+    put_le(out, 0, 2);
+    put_le(out, word, 8);
+    for(uint64_t hash_word : parms_hash)
+        put_le(out, hash_word, 8);
+}
+
+
+/**
+ * Check the magic number, the version and the parameters of a file header (see `FileHeaderPrefix`)
+ *
+ * @return  true if they are the expected ones
+ * */
+bool check_header_prefix(const unsigned char *data, uint32_t magic, uint16_t version, const parms_id_type &parms_hash)
+{
+    if(get_le(data, 0, 4) != magic || get_le(data, 4, 2) != version)
+        return false;
+    for(size_t word = 0; word < parms_hash.size(); word++)
+        if(get_le(data, 16 + 8 * word, 8) != parms_hash[word])
+            return false;
+    return true;
+}
+
+
+/**
+ * Write a whole file atomically and durably (see `AtomicFileWriter`)
+ *
+ * @param path  Output path
+ * @param data  Content of the file
+ * @param size  Size of the content (bytes)
+ *
+ * @return      true on success
+ * */
+bool write_file_atomic(string path, const void *data, size_t size)
+{
+    AtomicFileWriter writer;
+    return writer.open(path) && writer.write(data, size) && writer.commit();
+}
+
+
+/**
+ * Map a file of the library, if it exists and can hold its header
+ *
+ * @param path      File path
+ * @param file      Output, the mapping
+ * @param min_size  Size of the header of the file (bytes)
+ *
+ * @return          true if the file is mapped and at least `min_size` bytes long
+ * */
+bool map_existing_file(string path, MappedFile &file, size_t min_size)
+{
+    if(access(path.c_str(), R_OK) != 0)
+        return false;
+    return file.open(path) && file.getSize() >= min_size;
+}
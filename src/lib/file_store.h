@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "seal/seal.h"
+#include "ingest.h"
+
+using namespace std;
+using namespace seal;
+
+
+/**
+ * File written next to its final path and renamed over it by `commit`, after being flushed to disk: a
+ * reader sees either the previous file or the complete new one, also after a crash or with several
+ * writers of the same path. The temporary file is removed if the writer is destroyed before `commit`.
+ * Files are only readable by their owner.
+ * */
+class AtomicFileWriter
+{
+    public:
+        AtomicFileWriter() {}
+        AtomicFileWriter(const AtomicFileWriter &) = delete;
+        AtomicFileWriter &operator=(const AtomicFileWriter &) = delete;
+        ~AtomicFileWriter();
+
+        bool open(string path);
+        bool write(const void *data, size_t size);
+        bool commit();
+
+    private:
+        void discard();
+
+        string path;
+        string tmp_path;
+        int fd = -1;
+        bool ok = false;
+};
+
+
+/**
+ * Header shared by the files of the library (key files, query and plaintext caches), little-endian:
+ * the type-specific fields follow it
+ * */
+struct FileHeaderPrefix
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t word;                  // number of records, or reserved
+    parms_id_type parms_hash;       // `parms_id` of the encryption parameters
+};
+
+
+void put_le(unsigned char *&out, uint64_t value, size_t bytes);
+uint64_t get_le(const unsigned char *data, size_t offset, size_t bytes);
+void put_header_prefix(unsigned char *&out, uint32_t magic, uint16_t version, uint64_t word,
+        const parms_id_type &parms_hash);
+bool check_header_prefix(const unsigned char *data, uint32_t magic, uint16_t version, const parms_id_type &parms_hash);
+bool write_file_atomic(string path, const void *data, size_t size);
+bool map_existing_file(string path, MappedFile &file, size_t min_size);
@@ -0,0 +1,216 @@
+/** Permutation-based hashing of the items into bins, one bin per slot. The receiver places each of its
+ *  items in one of NUM_HASH_FUNCTIONS candidate bins with cuckoo hashing, the sender places each of 
+ *  its items in all of them (simple hashing). The sender polynomial is then evaluated per bin: its 
+ *  degree is the largest bin load instead of the size of the whole sender dataset. 
+ *  Since part of the item is implied by its bin, only the remaining bits are stored in the slots, and
+ *  the plain modulus only has to be larger than those (see `binning_plain_bits`).
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "hashing.h"
+
+#define AUDIT
+
+static const unsigned HASH_INDEX_BITS = 2;         // enough for NUM_HASH_FUNCTIONS values
+
+
+static inline unsigned log2_bins(const BinningParams &binning)
+{
+    return __builtin_ctzll(binning.num_bins);
+}
+
+
+static inline uint64_t item_mask(const BinningParams &binning)
+{
+    return binning.item_bits >= 64 ? ~0ULL : (1ULL << binning.item_bits) - 1;
+}
+
+
+/**
+ * @param poly_mod_degree   size of the polynomial modulus, one bin per slot
+ * @param item_bits         Width of the items
+ * @param seed              Seed of the hash functions, shared by sender and receiver
+ *
+ * @return                  The binning parameters
+ * */
+BinningParams make_binning_params(size_t poly_mod_degree, unsigned item_bits, uint64_t seed)
+{
+    BinningParams binning;
+    binning.num_bins = poly_mod_degree;
+    binning.item_bits = max(1U, min(64U, item_bits));
+    binning.seed = seed;
+    return binning;
+}
+
+
+/** Bits of an item stored in its slot: the part not implied by the bin, plus the hash function index */
+unsigned stored_item_bits(const BinningParams &binning)
+{
+    unsigned log_bins = log2_bins(binning);
+    return (binning.item_bits > log_bins ? binning.item_bits - log_bins : 0) + HASH_INDEX_BITS;
+}
+
+
+/** 
+ * Size of the plain modulus needed by the binned items: it must hold every stored value and the two
+ * dummy values used for empty receiver bins and sender padding, which are larger than all of them
+ * */
+int binning_plain_bits(const BinningParams &binning)
+{
+    return min(60, max(MIN_PLAIN_BITS, (int)stored_item_bits(binning) + 2));
+}
+
+
+/**
+ * @param item          The item
+ * @param hash_index    Index of the hash function, less than NUM_HASH_FUNCTIONS
+ * @param binning       Binning parameters
+ *
+ * @return              Bin of the item for the hash function: x_L ^ f_i(x_R)
+ * */
+size_t bin_index(uint64_t item, unsigned hash_index, const BinningParams &binning)
+{
+    item &= item_mask(binning);
+    uint64_t high = log2_bins(binning) >= 64 ? 0 : item >> log2_bins(binning);
+    uint64_t key = binning.seed + (hash_index + 1) * 0x9e3779b97f4a7c15ULL;
+    return (item ^ mix64(high ^ key)) & (binning.num_bins - 1);
+}
+
+
+/** Value stored in the slot of the item's bin: x_R followed by the hash function index */
+uint64_t stored_value(uint64_t item, unsigned hash_index, const BinningParams &binning)
+{
+    item &= item_mask(binning);
+    uint64_t high = log2_bins(binning) >= 64 ? 0 : item >> log2_bins(binning);
+    return (high << HASH_INDEX_BITS) | hash_index;
+}
+
+
+/**
+ * Inverse of the placement: the item is fully determined by its bin and its stored value
+ *
+ * @param bin       Bin of the item
+ * @param value     Value stored in the slot of the bin, see `stored_value`
+ * @param binning   Binning parameters
+ *
+ * @return          The item: x_R from the value, and x_L = bin ^ f_i(x_R)
+ * */
+uint64_t recover_item(size_t bin, uint64_t value, const BinningParams &binning)
+{
+    unsigned hash_index = value & ((1U << HASH_INDEX_BITS) - 1);
+    uint64_t high = value >> HASH_INDEX_BITS;
+    uint64_t key = binning.seed + (hash_index + 1) * 0x9e3779b97f4a7c15ULL;
+    uint64_t low = (bin ^ mix64(high ^ key)) & (binning.num_bins - 1);
+    return (log2_bins(binning) >= 64 ? low : (high << log2_bins(binning)) | low) & item_mask(binning);
+}
+
+
+/** Value of the receiver's empty bins, never equal to a stored value or to the sender padding */
+uint64_t empty_bin_value(const BinningParams &binning)
+{
+    return 1ULL << stored_item_bits(binning);
+}
+
+
+/** Value padding the sender's bins up to the largest load, never equal to a receiver value */
+uint64_t padding_value(const BinningParams &binning)
+{
+    return (1ULL << stored_item_bits(binning)) + 1;
+}
+
+
+/**
+ * Place the receiver's items in the bins with cuckoo hashing, at most one item per bin. Duplicated
+ * items are placed once.
+ *
+ * @param items         Receiver's items
+ * @param binning       Binning parameters
+ * @param bin_values    Output, the value of each bin (`empty_bin_value` for empty bins)
+ * @param bin_items     Output, the index in `items` of the item of each bin, -1 for empty bins
+ *
+ * @return              false if some item could not be placed (too many items for the bins)
+ * */
+bool cuckoo_hash(const vector<uint64_t> &items, const BinningParams &binning, vector<uint64_t> &bin_values, 
+        vector<int64_t> &bin_items)
+{
+    bin_values.assign(binning.num_bins, empty_bin_value(binning));
+    bin_items.assign(binning.num_bins, -1);
+    mt19937_64 rng(binning.seed);
+
+    for(size_t index = 0; index < items.size(); index++){
+        bool duplicate = false;
+        for(unsigned i = 0; i < NUM_HASH_FUNCTIONS && !duplicate; i++){
+            size_t bin = bin_index(items[index], i, binning);
+            duplicate = bin_items[bin] >= 0 && bin_values[bin] == stored_value(items[index], i, binning);
+        }
+        if(duplicate)
+            continue;
+
+        // Random walk: evict the item of one of the candidate bins, and place it in another of its bins
+        int64_t current = index;
+        unsigned evicted_from = NUM_HASH_FUNCTIONS;
+        for(size_t evictions = 0; current >= 0 && evictions <= CUCKOO_MAX_EVICTIONS; evictions++){
+            uint64_t item = items[current];
+            for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+                size_t bin = bin_index(item, i, binning);
+                if(bin_items[bin] < 0){
+                    bin_items[bin] = current;
+                    bin_values[bin] = stored_value(item, i, binning);
+                    current = -1;
+                    break;
+                }
+            }
+            if(current < 0)
+                break;
+
+            unsigned hash_index;
+            do
+                hash_index = rng() % NUM_HASH_FUNCTIONS;
+            while(hash_index == evicted_from);
+            size_t bin = bin_index(item, hash_index, binning);
+            int64_t evicted = bin_items[bin];
+            evicted_from = bin_values[bin] & ((1U << HASH_INDEX_BITS) - 1);
+            bin_items[bin] = current;
+            bin_values[bin] = stored_value(item, hash_index, binning);
+            current = evicted;
+        }
+
+        if(current >= 0){
+#ifdef AUDIT
+            printf("Cuckoo hashing failed after %zu items: too many items for %zu bins\n", index, binning.num_bins);
+#endif
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Place each of the sender's items in all its candidate bins. Duplicated items are placed once.
+ *
+ * @param items     Sender's items
+ * @param binning   Binning parameters
+ *
+ * @return          The stored values of each bin
+ * */
+vector<vector<uint64_t>> simple_hash(const vector<uint64_t> &items, const BinningParams &binning)
+{
+    vector<vector<uint64_t>> bins(binning.num_bins);
+    for(uint64_t item : items){
+        for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+            vector<uint64_t> &bin = bins[bin_index(item, i, binning)];
+            uint64_t value = stored_value(item, i, binning);
+            if(find(bin.begin(), bin.end(), value) == bin.end())
+                bin.push_back(value);
+        }
+    }
+    return bins;
+}
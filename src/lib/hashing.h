@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+
+#define NUM_HASH_FUNCTIONS 3
+#define CUCKOO_MAX_EVICTIONS 1000
+#define MIN_PLAIN_BITS 20
+
+
+/**
+ * Parameters of the permutation-based hashing of the items into bins (one bin per slot).
+ * An item x of `item_bits` bits is split into x_L (the low log2(num_bins) bits) and x_R (the others):
+ * with hash function i it goes to bin x_L ^ f_i(x_R), where only x_R and i are stored. Two items
+ * with the same stored value in the same bin are equal, so the slots need log2(num_bins) bits less.
+ * Sender and receiver must use the same parameters.
+ * */
+struct BinningParams
+{
+    size_t num_bins;            // power of two, the slot count
+    unsigned item_bits;         // width of the items (sigma)
+    uint64_t seed;              // seed of the hash functions
+};
+
+
+/** Finalizer of splitmix64, used as a family of hash functions indexed by the seed */
+static inline uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+BinningParams make_binning_params(size_t poly_mod_degree, unsigned item_bits, uint64_t seed = 0);
+unsigned stored_item_bits(const BinningParams &binning);
+int binning_plain_bits(const BinningParams &binning);
+size_t bin_index(uint64_t item, unsigned hash_index, const BinningParams &binning);
+uint64_t stored_value(uint64_t item, unsigned hash_index, const BinningParams &binning);
+uint64_t recover_item(size_t bin, uint64_t value, const BinningParams &binning);
+uint64_t empty_bin_value(const BinningParams &binning);
+uint64_t padding_value(const BinningParams &binning);
+bool cuckoo_hash(const vector<uint64_t> &items, const BinningParams &binning, vector<uint64_t> &bin_values, 
+        vector<int64_t> &bin_items);
+vector<vector<uint64_t>> simple_hash(const vector<uint64_t> &items, const BinningParams &binning);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+
+#define MIN_BYTES_PER_THREAD (1UL << 20)      // smallest part of a file parsed by a thread of its own
+
+
+/** Read-only memory mapping of a whole file, unmapped on destruction. The mapping can be moved, not copied */
+class MappedFile
+{
+    public:
+        MappedFile() {}
+        MappedFile(MappedFile &&other) noexcept
+            : data(exchange(other.data, nullptr)), size(exchange(other.size, 0)) {}
+        MappedFile &operator=(MappedFile &&other) noexcept;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+        bool open(string path);
+        void close();
+        const char *getData(){ return this->data; }
+        size_t getSize(){ return this->size; }
+
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+};
+
+
+const char *find_newline(const char *begin, const char *end);
+size_t pack_bitstring(const char *begin, const char *end, size_t max_length, uint64_t &value);
+vector<pair<const char *, const char *>> split_lines(const char *data, size_t size, size_t num_parts);
+bool parse_bitstring_lines(const char *begin, const char *end, const char *limit, vector<uint64_t> &values, 
+        ItemStore *items);
+bool parse_bitstring_file(const char *data, size_t size, vector<uint64_t> &values, ItemStore *items, 
+        size_t num_threads = 0);
+vector<uint64_t> mmap_bitstring_to_long_dataset(string dataset_path);
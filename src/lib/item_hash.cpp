@@ -0,0 +1,198 @@
+/** Arbitrary-string items: each line of the dataset (an email, a UUID, any byte string) is hashed with a 
+ *  keyed hash into an item of `item_bits` bits, which takes the place of the parsed bitstring. 
+ *  The hash consumes 16 bytes per step with one 64x64->128 bit multiplication, so its cost is dominated 
+ *  by the memory bandwidth rather than by per-character work. 
+ *  The receiver keeps the original strings next to the hashed values, so the intersection is output in 
+ *  the original form. Two different strings can map to the same item: with n_s sender and n_r receiver 
+ *  items the expected number of false matches is about n_s * n_r / 2^b, with b = `item_bits` (see
+ *  `DEFAULT_ITEM_BITS`). The items are encoded as they are, so without binning `item_bits` must be
+ *  smaller than the plain modulus size.
+ * */
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "dedup.h"
+#include "ingest.h"
+#include "item_hash.h"
+#include "parallel.h"
+
+#define AUDIT
+
+static const uint64_t P0 = 0xa0761d6478bd642fULL;
+static const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t P3 = 0x589965cc75374cc3ULL;
+
+
+/** Multiply two 64 bit words and fold the 128 bit product */
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+
+static inline uint64_t read64(const char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+/** Read the last 1..16 bytes of an item as two words, without reading past its end */
+static inline void read_tail(const char *p, size_t length, uint64_t &a, uint64_t &b)
+{
+    a = b = 0;
+    if(length >= 8){
+        a = read64(p);
+        b = read64(p + length - 8);
+    }
+    else
+        memcpy(&a, p, length);
+}
+
+
+/**
+ * Hash an arbitrary byte string into an item
+ *
+ * @param data          First byte of the string
+ * @param length        Length of the string (bytes)
+ * @param key           Key of the hash, shared by sender and receiver
+ * @param item_bits     Width of the output item (1 to 64 bits)
+ *
+ * @return              The item, on the lowest `item_bits` bits
+ * */
+uint64_t hash_item(const char *data, size_t length, const ItemHashKey &key, unsigned item_bits)
+{
+    uint64_t seed = mix(key.k0 ^ P0, length ^ key.k1 ^ P1);
+    size_t remaining = length;
+    const char *p = data;
+
+    for(; remaining > 16; remaining -= 16, p += 16)
+        seed = mix(read64(p) ^ P1 ^ key.k1, read64(p + 8) ^ seed);
+
+    uint64_t a, b;
+    read_tail(p, remaining, a, b);
+    uint64_t hash = mix(P2 ^ length, mix(a ^ P1 ^ key.k1, b ^ seed ^ P3));
+
+    return item_bits >= 64 ? hash : hash & ((1ULL << item_bits) - 1);
+}
+
+
+uint64_t hash_item(string_view item, const ItemHashKey &key, unsigned item_bits)
+{
+    return hash_item(item.data(), item.size(), key, item_bits);
+}
+
+
+/**
+ * Expected number of false matches between hashed datasets: pairs of different strings mapped to the
+ * same item
+ *
+ * @param sender_items      Items of the sender
+ * @param receiver_items    Items of the receiver query
+ * @param item_bits         Width of the hashed items
+ *
+ * @return                  sender_items * receiver_items / 2^item_bits
+ * */
+double expected_false_matches(size_t sender_items, size_t receiver_items, unsigned item_bits)
+{
+    return ldexp((double)sender_items * (double)receiver_items, -(int)min(64U, item_bits));
+}
+
+
+/**
+ * Hash every item of a store
+ *
+ * @param items         Original strings
+ * @param key           Key of the hash
+ * @param item_bits     Width of the output items
+ *
+ * @return              The hashed items, in the same order
+ * */
+vector<uint64_t> hash_items(const ItemStore &items, const ItemHashKey &key, unsigned item_bits)
+{
+    vector<uint64_t> hashed(items.size());
+    for(size_t index = 0; index < items.size(); index++)
+        hashed[index] = hash_item(items.getItem(index), key, item_bits);
+    return hashed;
+}
+
+
+/**
+ * Load a dataset of arbitrary strings, one per line (a trailing '\r' is dropped, empty lines are 
+ * skipped), hashing each of them into an item
+ *
+ * @param dataset_path  Path of the dataset
+ * @param key           Key of the hash, shared by sender and receiver
+ * @param item_bits     Width of the items (1 to 64 bits)
+ * @param deduplicate   Remove the items whose hash is duplicated (the first occurrence is kept)
+ *
+ * @return              The dataset: hashed items, original strings and sigma = item_bits
+ * */
+Dataset load_hashed_dataset(string dataset_path, const ItemHashKey &key, unsigned item_bits, bool deduplicate)
+{
+    Dataset dataset;
+    vector<uint64_t> longint_dataset;
+    ItemStore items;
+    item_bits = max(1U, min(64U, item_bits));
+
+    // Each thread hashes the lines of its part of the file into its own buffers
+    MappedFile file;
+    if(file.open(dataset_path)){
+        vector<pair<const char *, const char *>> parts = split_lines(file.getData(), file.getSize(), 
+                choose_threads(file.getSize(), MIN_BYTES_PER_THREAD, 0));
+        vector<vector<uint64_t>> part_values(parts.size());
+        vector<ItemStore> part_items(parts.size());
+
+        run_on_threads(parts.size(), [&](size_t t){
+            const char *pos = parts[t].first;
+            const char *end = parts[t].second;
+            while(pos < end){
+                const char *line_end = find_newline(pos, end);
+                size_t length = line_end - pos;
+                if(length > 0 && pos[length - 1] == '\r')
+                    length--;
+                if(length > 0){
+                    part_values[t].push_back(hash_item(pos, length, key, item_bits));
+                    part_items[t].push_back(pos, length);
+                }
+                pos = line_end + 1;
+            }
+        });
+
+        for(size_t t = 0; t < parts.size(); t++){
+            longint_dataset.insert(longint_dataset.end(), part_values[t].begin(), part_values[t].end());
+            items.append(part_items[t]);
+        }
+    }
+
+#ifdef AUDIT
+    if(longint_dataset.size() == 0)
+        printf("Hashed dataset %s is empty\n", dataset_path.c_str());
+#endif
+    dataset.setSigmaLength(item_bits);
+    dataset.setLongDataset(move(longint_dataset));
+    dataset.setItemStore(move(items));
+    if(deduplicate){
+#ifdef AUDIT
+        DedupStats stats = dedup_dataset(dataset);
+        printf("Hashed dataset %s: %zu items, %zu duplicates removed\n", dataset_path.c_str(), 
+                stats.input_items, stats.duplicates);
+#else
+        dedup_dataset(dataset);
+#endif
+    }
+    return dataset;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+
+/* Width of the hashed items. Two different strings map to the same item with probability 2^-item_bits,
+ * so n_r receiver items against n_s sender items give about n_s * n_r / 2^item_bits false matches:
+ * 0.01 for 10^5 x 10^5 items at 40 bits, tens of thousands at 20 bits. Items this wide only fit the
+ * plain modulus when they are placed in bins (see `make_binning_params`), which store log2(slots) bits
+ * less per item: without binning they must be narrower than the plain modulus (20 bits by default). */
+#define DEFAULT_ITEM_BITS 40
+#define MAX_EXPECTED_FALSE_MATCHES 0.1      // per full query, above it a hashed sender dataset is refused
+
+
+/** 
+ * Key of the item hash: sender and receiver must use the same key (and the same item width) for their
+ * items to match. Changing the key changes every hashed value.
+ * */
+struct ItemHashKey
+{
+    uint64_t k0;
+    uint64_t k1;
+};
+
+
+uint64_t hash_item(const char *data, size_t length, const ItemHashKey &key, unsigned item_bits);
+uint64_t hash_item(string_view item, const ItemHashKey &key, unsigned item_bits);
+double expected_false_matches(size_t sender_items, size_t receiver_items, unsigned item_bits);
+vector<uint64_t> hash_items(const ItemStore &items, const ItemHashKey &key, unsigned item_bits);
+Dataset load_hashed_dataset(string dataset_path, const ItemHashKey &key, unsigned item_bits, 
+        bool deduplicate = false);
@@ -0,0 +1,263 @@
+/** Key cache of the sender service: receivers that come back with the same parameters skip key
+ *  upload and deserialization, because their `RelinKeys` are kept here until evicted.
+ * */
+
+
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "key_cache.h"
+
+using namespace std;
+using namespace seal;
+
+#define CACHE_AUDIT
+
+
+/**
+ * @param memory_cap    Maximum amount of memory (bytes) used by the cached keys and reserved with `reserve`
+ * */
+KeyCache::KeyCache(size_t memory_cap)
+{
+    this->memory_cap = memory_cap;
+}
+
+
+/**
+ * Return the context for the given parameters, creating it if no cached receiver is using it
+ *
+ * @param params    Encryption parameters
+ *
+ * @return          Shared SEALContext
+ * */
+shared_ptr<SEALContext> KeyCache::get_context(EncryptionParameters params)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    return get_context_locked(params);
+}
+
+
+shared_ptr<SEALContext> KeyCache::get_context_locked(EncryptionParameters params)
+{
+    parms_id_type parms_hash = params.parms_id();
+    shared_ptr<SEALContext> context = this->contexts[parms_hash].lock();
+    if(!context){
+        context = make_shared<SEALContext>(params);
+        this->contexts[parms_hash] = context;
+    }
+    return context;
+}
+
+
+/**
+ * Look for the keys of a receiver, marking them as most recently used
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param parms_hash    parms_id of the parameters used by the receiver
+ *
+ * @return              Cached keys, with null pointers on a miss
+ * */
+CachedKeys KeyCache::lookup(string receiver_id, parms_id_type parms_hash)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    auto found = this->index.find(EntryKey(receiver_id, parms_hash));
+    if(found == this->index.end()){
+        this->stats.misses++;
+        return CachedKeys();
+    }
+
+    this->stats.hits++;
+    this->lru.splice(this->lru.begin(), this->lru, found->second);
+    return found->second->keys;
+}
+
+
+/**
+ * Check whether the keys of a receiver are cached, without counting a hit or a miss and without
+ * marking them as recently used (e.g. to decide whether the receiver has to upload them)
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param parms_hash    parms_id of the parameters used by the receiver
+ *
+ * @return              true if the keys are cached
+ * */
+bool KeyCache::contains(string receiver_id, parms_id_type parms_hash)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    return this->index.find(EntryKey(receiver_id, parms_hash)) != this->index.end();
+}
+
+
+/**
+ * Deserialize the relinearization keys uploaded by a receiver and cache them
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param params        Encryption parameters used by the receiver
+ * @param data          Serialized RelinKeys
+ * @param size          Size of the serialized keys (bytes)
+ *
+ * @return              The cached keys, with null pointers if they could not be loaded
+ * */
+CachedKeys KeyCache::insert(string receiver_id, EncryptionParameters params, const seal_byte *data, size_t size)
+{
+    shared_ptr<SEALContext> context = get_context(params);
+    shared_ptr<RelinKeys> relin_keys = make_shared<RelinKeys>();
+
+    // Deserialization is the expensive part, do it without holding the lock
+    try{
+        relin_keys->load(*context, data, size);
+    }
+    catch (exception& e){
+#ifdef CACHE_AUDIT
+        printf("Cache: invalid keys uploaded by receiver %s\n", receiver_id.c_str());
+#endif
+        return CachedKeys();
+    }
+
+    CachedKeys keys;
+    keys.context = context;
+    keys.relin_keys = relin_keys;
+
+    lock_guard<mutex> lock(this->cache_mutex);
+    return insert_locked(receiver_id, params.parms_id(), keys);
+}
+
+
+/**
+ * Cache relinearization keys that are already deserialized
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param params        Encryption parameters used by the receiver
+ * @param relin_keys    Relinearization keys of the receiver
+ *
+ * @return              The cached keys
+ * */
+CachedKeys KeyCache::insert(string receiver_id, EncryptionParameters params, RelinKeys relin_keys)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+
+    CachedKeys keys;
+    keys.context = get_context_locked(params);
+    keys.relin_keys = make_shared<RelinKeys>(move(relin_keys));
+    return insert_locked(receiver_id, params.parms_id(), keys);
+}
+
+
+CachedKeys KeyCache::insert_locked(string receiver_id, parms_id_type parms_hash, CachedKeys keys)
+{
+    EntryKey key(receiver_id, parms_hash);
+    auto found = this->index.find(key);
+    if(found != this->index.end()){
+        this->stats.bytes_in_use -= found->second->size_bytes;
+        this->lru.erase(found->second);
+        this->index.erase(found);
+    }
+
+    // The uncompressed serialized size is a good estimate of the memory held by the keys
+    size_t size_bytes = keys.relin_keys->save_size(compr_mode_type::none);
+    if(size_bytes + this->stats.bytes_reserved > this->memory_cap){
+#ifdef CACHE_AUDIT
+        printf("Cache: keys of receiver %s exceed the memory cap, not cached\n", receiver_id.c_str());
+#endif
+        this->stats.entries = this->lru.size();
+        return keys;
+    }
+    evict_locked(size_bytes);
+
+    Entry entry;
+    entry.receiver_id = receiver_id;
+    entry.parms_hash = parms_hash;
+    entry.keys = keys;
+    entry.size_bytes = size_bytes;
+    this->lru.push_front(entry);
+    this->index[key] = this->lru.begin();
+
+    this->stats.insertions++;
+    this->stats.bytes_in_use += size_bytes;
+    this->stats.entries = this->lru.size();
+    return keys;
+}
+
+
+/**
+ * Evict least recently used entries until `bytes_needed` more bytes fit under the memory cap.
+ * Keys still used by an in-flight query stay alive until the query completes.
+ * */
+void KeyCache::evict_locked(size_t bytes_needed)
+{
+    while(!this->lru.empty() && this->stats.bytes_in_use + this->stats.bytes_reserved + bytes_needed > 
+            this->memory_cap){
+        Entry &victim = this->lru.back();
+        this->stats.evictions++;
+        this->stats.evicted_bytes += victim.size_bytes;
+        this->stats.bytes_in_use -= victim.size_bytes;
+        this->index.erase(EntryKey(victim.receiver_id, victim.parms_hash));
+        this->lru.pop_back();
+    }
+
+    // Forget contexts that are no longer used by anyone
+    for(auto it = this->contexts.begin(); it != this->contexts.end();){
+        if(it->second.expired())
+            it = this->contexts.erase(it);
+        else
+            it++;
+    }
+}
+
+
+/**
+ * Remove the keys of a receiver (e.g. when it rotates them)
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param parms_hash    parms_id of the parameters used by the receiver
+ * */
+void KeyCache::erase(string receiver_id, parms_id_type parms_hash)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    auto found = this->index.find(EntryKey(receiver_id, parms_hash));
+    if(found == this->index.end())
+        return;
+
+    this->stats.bytes_in_use -= found->second->size_bytes;
+    this->lru.erase(found->second);
+    this->index.erase(found);
+    this->stats.entries = this->lru.size();
+}
+
+
+/**
+ * Reserve memory under the cap for data pinned by the cached keys, evicting keys to make room for it
+ *
+ * @param bytes     Memory to reserve
+ *
+ * @return          false if it does not fit under the cap even with no keys cached (nothing is reserved)
+ * */
+bool KeyCache::reserve(size_t bytes)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    if(this->stats.bytes_reserved + bytes > this->memory_cap)
+        return false;
+    this->stats.bytes_reserved += bytes;
+    evict_locked(0);
+    this->stats.entries = this->lru.size();
+    return true;
+}
+
+
+/**
+ * Release memory reserved with `reserve`
+ * */
+void KeyCache::release(size_t bytes)
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    this->stats.bytes_reserved -= bytes < this->stats.bytes_reserved ? bytes : this->stats.bytes_reserved;
+}
+
+
+KeyCacheStats KeyCache::getStats()
+{
+    lock_guard<mutex> lock(this->cache_mutex);
+    return this->stats;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "seal/seal.h"
+
+using namespace std;
+using namespace seal;
+
+
+/** Keys of a receiver together with the context they were loaded with */
+struct CachedKeys
+{
+    shared_ptr<SEALContext> context;
+    shared_ptr<const RelinKeys> relin_keys;
+};
+
+
+/** Counters describing how the key cache is behaving */
+struct KeyCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t insertions = 0;
+    size_t evictions = 0;
+    size_t evicted_bytes = 0;
+    size_t bytes_in_use = 0;
+    size_t bytes_reserved = 0;      // memory pinned by the keys outside the cache, see `reserve`
+    size_t entries = 0;
+};
+
+
+/**
+ * LRU cache of deserialized relinearization keys, keyed by receiver ID and parameter hash (the SEAL
+ * `parms_id` of the encryption parameters). Contexts are shared between all the receivers using the
+ * same parameters. When the size of the cached keys, plus the memory reserved for what they pin (the
+ * sender set encoded for their parameters), exceeds the memory cap, the least recently used entries
+ * are evicted.
+ * */
+class KeyCache
+{
+    public:
+        KeyCache(size_t memory_cap);
+
+        shared_ptr<SEALContext> get_context(EncryptionParameters params);
+        CachedKeys lookup(string receiver_id, parms_id_type parms_hash);
+        bool contains(string receiver_id, parms_id_type parms_hash);
+        CachedKeys insert(string receiver_id, EncryptionParameters params, const seal_byte *data, size_t size);
+        CachedKeys insert(string receiver_id, EncryptionParameters params, RelinKeys relin_keys);
+        void erase(string receiver_id, parms_id_type parms_hash);
+        bool reserve(size_t bytes);
+        void release(size_t bytes);
+
+        KeyCacheStats getStats();
+        size_t getMemoryCap(){ return this->memory_cap; }
+
+    private:
+        struct Entry
+        {
+            string receiver_id;
+            parms_id_type parms_hash;
+            CachedKeys keys;
+            size_t size_bytes;
+        };
+        typedef pair<string, parms_id_type> EntryKey;
+
+        shared_ptr<SEALContext> get_context_locked(EncryptionParameters params);
+        CachedKeys insert_locked(string receiver_id, parms_id_type parms_hash, CachedKeys keys);
+        void evict_locked(size_t bytes_needed);
+
+        size_t memory_cap;
+        mutex cache_mutex;
+        list<Entry> lru;                                    // most recently used first
+        map<EntryKey, list<Entry>::iterator> index;
+        map<parms_id_type, weak_ptr<SEALContext>> contexts;
+        KeyCacheStats stats;
+};
@@ -0,0 +1,161 @@
+/** Persistent receiver keys: key generation (the relinearization keys above all) is the slowest part of
+ *  the receiver setup, so the keys can be generated offline (see `src/tools/generate_keys.cpp`), saved
+ *  in one file per parameter set and loaded at startup instead of being generated for every query.
+ *  Keys are stored uncompressed, so loading them is a copy out of the mapped file.
+ * */
+
+
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+#include "file_store.h"
+#include "ingest.h"
+#include "key_store.h"
+#include "receiver.h"
+
+using namespace std;
+using namespace seal;
+
+#define KEYS_AUDIT
+
+
+/**
+ * Path of the key file for the given parameters in a key directory
+ *
+ * @param key_dir   Directory holding the key files
+ * @param params    Encryption parameters of the keys
+ *
+ * @return          `key_dir`/recv_keys_<parms hash in hex>.bin
+ * */
+string receiver_keys_path(string key_dir, EncryptionParameters params)
+{
+    char name[96];
+    parms_id_type parms_hash = params.parms_id();
+    snprintf(name, sizeof(name), "recv_keys_%016llx%016llx%016llx%016llx.bin", (unsigned long long)parms_hash[0],
+            (unsigned long long)parms_hash[1], (unsigned long long)parms_hash[2], (unsigned long long)parms_hash[3]);
+    return key_dir + "/" + name;
+}
+
+
+/**
+ * Save the keys of a receiver, atomically (see `write_file_atomic`); the file is only readable by its
+ * owner, since it holds the secret key.
+ *
+ * @param path      Output path (see `receiver_keys_path`)
+ * @param params    Encryption parameters the keys were generated with
+ * @param recv      Receiver holding the keys
+ *
+ * @return          true on success
+ * */
+bool save_receiver_keys(string path, EncryptionParameters params, const Receiver &recv)
+{
+    size_t sk_size = recv.getRecvSk().save_size(compr_mode_type::none);
+    size_t pk_size = recv.getRecvPk().save_size(compr_mode_type::none);
+    size_t relin_size = recv.getRelinKeys().save_size(compr_mode_type::none);
+    vector<seal_byte> buffer(sizeof(KeyFileHeader) + 3 * 8 + sk_size + pk_size + relin_size);
+
+    unsigned char *out = (unsigned char *)buffer.data();
+    put_header_prefix(out, KEY_FILE_MAGIC, KEY_FILE_VERSION, 0, params.parms_id());
+    put_le(out, sk_size, 8);
+    out += recv.getRecvSk().save((seal_byte *)out, sk_size, compr_mode_type::none);
+    put_le(out, pk_size, 8);
+    out += recv.getRecvPk().save((seal_byte *)out, pk_size, compr_mode_type::none);
+    put_le(out, relin_size, 8);
+    out += recv.getRelinKeys().save((seal_byte *)out, relin_size, compr_mode_type::none);
+    return write_file_atomic(path, buffer.data(), out - (unsigned char *)buffer.data());
+}
+
+
+/**
+ * Load the keys saved by `save_receiver_keys`
+ *
+ * @param path      Key file path
+ * @param params    Encryption parameters the keys must have been generated with
+ * @param recv      Output, receiver whose keys are set
+ *
+ * @return          true on success, false if the file is missing, invalid or made for other parameters
+ * */
+bool load_receiver_keys(string path, EncryptionParameters params, Receiver &recv)
+{
+    MappedFile file;
+    if(!map_existing_file(path, file, sizeof(KeyFileHeader)))
+        return false;
+
+    const unsigned char *data = (const unsigned char *)file.getData();
+    size_t size = file.getSize();
+    if(!check_header_prefix(data, KEY_FILE_MAGIC, KEY_FILE_VERSION, params.parms_id())){
+#ifdef KEYS_AUDIT
+        printf("key store: %s does not hold keys for these parameters\n", path.c_str());
+#endif
+        return false;
+    }
+
+    SEALContext context(params);
+    SecretKey sk;
+    PublicKey pk;
+    RelinKeys relin_keys;
+    size_t offset = sizeof(KeyFileHeader);
+    auto load_next = [&](auto &key){
+        if(size - offset < 8)
+            return false;
+        uint64_t key_size = get_le(data, offset, 8);
+        offset += 8;
+        if(key_size > size - offset)
+            return false;
+        key.load(context, (const seal_byte *)data + offset, key_size);
+        offset += key_size;
+        return true;
+    };
+    try{
+        if(!load_next(sk) || !load_next(pk) || !load_next(relin_keys)){
+#ifdef KEYS_AUDIT
+            printf("key store: %s is truncated\n", path.c_str());
+#endif
+            return false;
+        }
+    }
+    catch (exception& e){
+#ifdef KEYS_AUDIT
+        printf("key store: invalid keys in %s\n", path.c_str());
+#endif
+        return false;
+    }
+
+    recv.setRecvSk(sk);
+    recv.setRecvPk(pk);
+    recv.setRelinKeys(relin_keys);
+    return true;
+}
+
+
+/**
+ * Same as `setup_pk_sk`, reusing the keys saved in `key_dir` for these parameters if there are any;
+ * otherwise the keys are generated and saved for the next runs
+ *
+ * @param params    Encryption parameters
+ * @param key_dir   Directory holding the key files
+ *
+ * @return          Receiver holding the keys
+ * */
+Receiver load_or_setup_pk_sk(EncryptionParameters params, string key_dir)
+{
+    Receiver recv;
+    string path = receiver_keys_path(key_dir, params);
+    if(load_receiver_keys(path, params, recv))
+        return recv;
+
+    recv = setup_pk_sk(params);
+    if(!save_receiver_keys(path, params, recv)){
+#ifdef KEYS_AUDIT
+        printf("key store: cannot save the keys in %s\n", path.c_str());
+#endif
+    }
+    return recv;
+}
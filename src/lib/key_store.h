@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "seal/seal.h"
+#include "utils.h"
+
+using namespace std;
+using namespace seal;
+
+
+#define KEY_FILE_MAGIC 0x4B495350U          // "PSIK" in little-endian
+#define KEY_FILE_VERSION 1
+
+
+/**
+ * Header of a receiver key file (48 bytes, little-endian), followed by the secret key, the public key
+ * and the relinearization keys, each stored as [size (8 bytes)][uncompressed SEAL serialization]
+ * */
+struct KeyFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t reserved2;
+    parms_id_type parms_hash;       // `parms_id` of the parameters the keys were generated for
+};
+
+
+string receiver_keys_path(string key_dir, EncryptionParameters params);
+bool save_receiver_keys(string path, EncryptionParameters params, const Receiver &recv);
+bool load_receiver_keys(string path, EncryptionParameters params, Receiver &recv);
+Receiver load_or_setup_pk_sk(EncryptionParameters params, string key_dir);
@@ -0,0 +1,246 @@
+/** Packed binary format for PSI datasets: a fixed header recording the bit-width and the number of
+ *  items, followed by the items themselves, little-endian, on the minimum number of bytes.
+ *  Loading such a file is a memory copy (or a byte shuffle for widths that are not 64 bits) instead of
+ *  parsing ASCII bitstrings at every restart.
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_store.h"
+#include "ingest.h"
+#include "packed_dataset.h"
+
+#define AUDIT
+
+
+static bool host_is_little_endian()
+{
+    uint16_t probe = 1;
+    return *(unsigned char *)&probe == 1;
+}
+
+
+/** Whether all the items fit in `item_bits` bits */
+static bool items_fit(const vector<uint64_t> &items, unsigned item_bits)
+{
+    uint64_t bits = 0;
+    for(uint64_t item : items)
+        bits |= item;
+    return item_bits >= 64 || (bits >> item_bits) == 0;
+}
+
+
+/**
+ * Check whether a file is in the packed binary format, looking at its magic number
+ *
+ * @param path  Dataset path
+ *
+ * @return      true if the file starts with a packed dataset header
+ * */
+bool is_packed_dataset(string path)
+{
+    ifstream file(path, ios::in | ios::binary);
+    unsigned char magic[4];
+    if(!file.read((char *)magic, sizeof(magic)))
+        return false;
+    uint32_t value = magic[0] | (magic[1] << 8) | (magic[2] << 16) | ((uint32_t)magic[3] << 24);
+    return value == PACKED_DATASET_MAGIC;
+}
+
+
+/**
+ * Read and validate the header of a packed dataset (shared by `load_packed_dataset` and the streaming
+ * `DatasetChunkReader`)
+ *
+ * @param data          First bytes of the file, at least `sizeof(PackedDatasetHeader)` if the file is
+ *                      that long
+ * @param file_size     Size of the whole file (bytes)
+ * @param header        Output, the fields of the header
+ *
+ * @return              true if the header is valid and the file is long enough for its items
+ * */
+bool parse_packed_header(const unsigned char *data, uint64_t file_size, PackedDatasetHeader &header)
+{
+    if(file_size < sizeof(PackedDatasetHeader))
+        return false;
+    header.magic = get_le(data, 0, 4);
+    header.version = get_le(data, 4, 2);
+    header.item_bits = get_le(data, 6, 1);
+    header.flags = get_le(data, 7, 1);
+    header.count = get_le(data, 8, 8);
+    header.item_bytes = get_le(data, 16, 4);
+    header.reserved = 0;
+    header.reserved2 = 0;
+    return header.magic == PACKED_DATASET_MAGIC && header.version == PACKED_DATASET_VERSION && 
+        header.item_bits > 0 && header.item_bits <= 64 && header.item_bytes == (header.item_bits + 7U) / 8 &&
+        header.count <= (file_size - sizeof(PackedDatasetHeader)) / header.item_bytes;
+}
+
+
+/**
+ * Write a dataset in the packed binary format
+ *
+ * @param path          Output path
+ * @param items         Items of the dataset
+ * @param item_bits     Length (bits) of each item
+ * @param sort_dedup    Sort the items and remove duplicates before writing them
+ *
+ * @return              true on success, false if an item does not fit in `item_bits` bits
+ * */
+bool write_packed_dataset(string path, vector<uint64_t> items, uint8_t item_bits, bool sort_dedup)
+{
+    if(item_bits == 0 || item_bits > 64 || !items_fit(items, item_bits)){
+#ifdef AUDIT
+        printf("packed dataset: invalid item width %d\n", item_bits);
+#endif
+        return false;
+    }
+
+    PackedDatasetHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACKED_DATASET_MAGIC;
+    header.version = PACKED_DATASET_VERSION;
+    header.item_bits = item_bits;
+    header.item_bytes = (item_bits + 7) / 8;
+    if(sort_dedup){
+        sort(items.begin(), items.end());
+        items.erase(unique(items.begin(), items.end()), items.end());
+        header.flags = PACKED_FLAG_SORTED | PACKED_FLAG_DEDUPLICATED;
+    }
+    header.count = items.size();
+
+    ofstream file(path, ios::out | ios::binary | ios::trunc);
+    if(!file.is_open()){
+#ifdef AUDIT
+        cout << "cannot open file with path: " << path << endl;
+#endif
+        return false;
+    }
+
+    // The header fields are stored little-endian like the items
+    vector<unsigned char> buffer(sizeof(header) + items.size() * header.item_bytes);
+    unsigned char *out = buffer.data();
+    put_le(out, header.magic, 4);
+    put_le(out, header.version, 2);
+    put_le(out, header.item_bits, 1);
+    put_le(out, header.flags, 1);
+    put_le(out, header.count, 8);
+    put_le(out, header.item_bytes, 4);
+    put_le(out, 0, 4);
+    put_le(out, 0, 8);
+    for(uint64_t item : items)
+        put_le(out, item, header.item_bytes);
+
+    file.write((const char *)buffer.data(), buffer.size());
+    return file.good();
+}
+
+
+/**
+ * Convert a bitstring CSV dataset into the packed binary format. The format has a single item width, from
+ * which the bitstrings are rebuilt: all the lines must have the same length, or the conversion fails, as
+ * it does on a line that is not a bitstring (no file is written then)
+ *
+ * @param csv_path      Path of the CSV dataset (one bitstring per line)
+ * @param packed_path   Output path
+ * @param sort_dedup    Sort the items and remove duplicates
+ *
+ * @return              true on success
+ * */
+bool convert_csv_to_packed(string csv_path, string packed_path, bool sort_dedup)
+{
+    bool complete;
+    Dataset dataset = load_dataset(csv_path, false, &complete);
+    if(!complete || dataset.getLongDatasetRef().size() == 0)
+        return false;
+
+    const ItemStore &items = dataset.getItemStore();
+    size_t item_bits = dataset.getSigmaLength();
+    for(size_t index = 0; index < items.size(); index++){
+        if(items.getItem(index).length() != item_bits){
+#ifdef AUDIT
+            printf("packed dataset: line %zu of %s has %zu bits, line 1 has %zu\n", index + 1, csv_path.c_str(),
+                    items.getItem(index).length(), item_bits);
+#endif
+            return false;
+        }
+    }
+    return write_packed_dataset(packed_path, dataset.getLongDatasetRef(), (uint8_t)item_bits, sort_dedup);
+}
+
+
+/**
+ * Load a packed binary dataset, mapping the file in memory
+ *
+ * @param path          Dataset path
+ * @param with_strings  Also rebuild the bitstrings (needed by the receiver to output the intersection)
+ *
+ * @return              The dataset, empty if the file is not valid
+ * */
+Dataset load_packed_dataset(string path, bool with_strings)
+{
+    Dataset dataset;
+    dataset.setSigmaLength(0);
+
+    MappedFile file;
+    if(!file.open(path))
+        return dataset;
+
+    const unsigned char *data = (const unsigned char *)file.getData();
+    PackedDatasetHeader header;
+    if(!parse_packed_header(data, file.getSize(), header)){
+#ifdef AUDIT
+        printf("packed dataset: invalid header in %s\n", path.c_str());
+#endif
+        return dataset;
+    }
+    uint8_t item_bits = header.item_bits;
+    uint64_t count = header.count;
+    uint32_t item_bytes = header.item_bytes;
+
+    vector<uint64_t> items(count);
+    const unsigned char *payload = data + sizeof(PackedDatasetHeader);
+    if(item_bytes == sizeof(uint64_t) && host_is_little_endian())
+        memcpy(items.data(), payload, count * sizeof(uint64_t));
+    else if(host_is_little_endian()){
+        for(uint64_t index = 0; index < count; index++){
+            uint64_t value = 0;
+            memcpy(&value, payload + index * item_bytes, item_bytes);     // low bytes first
+            items[index] = value;
+        }
+    }
+    else{
+        for(uint64_t index = 0; index < count; index++)
+            items[index] = get_le(data, sizeof(PackedDatasetHeader) + index * item_bytes, item_bytes);
+    }
+    if(!items_fit(items, item_bits)){
+#ifdef AUDIT
+        printf("packed dataset: items wider than %d bits in %s\n", item_bits, path.c_str());
+#endif
+        return dataset;
+    }
+
+    if(with_strings){
+        ItemStore store;
+        store.reserve(count, count * item_bits);
+        string bitstring(item_bits, '0');
+        for(uint64_t item : items){
+            for(int bit = 0; bit < item_bits; bit++)
+                bitstring[bit] = '0' + ((item >> (item_bits - 1 - bit)) & 1);
+            store.push_back(bitstring);
+        }
+        dataset.setItemStore(move(store));
+    }
+
+    dataset.setSigmaLength(item_bits);
+    dataset.setLongDataset(move(items));
+    return dataset;
+}
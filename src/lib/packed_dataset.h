@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+using namespace std;
+
+
+#define PACKED_DATASET_MAGIC 0x44495350U       // "PSID" in little-endian
+#define PACKED_DATASET_VERSION 1
+#define PACKED_FLAG_SORTED 0x1
+#define PACKED_FLAG_DEDUPLICATED 0x2
+
+
+/**
+ * Header of the packed binary dataset format (32 bytes, little-endian), followed by `count` items of
+ * `item_bytes` bytes each, little-endian
+ * */
+struct PackedDatasetHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t item_bits;          // length of the bitstrings (sigma)
+    uint8_t flags;              // PACKED_FLAG_*
+    uint64_t count;
+    uint32_t item_bytes;        // ceil(item_bits / 8)
+    uint32_t reserved;
+    uint64_t reserved2;
+};
+
+
+bool is_packed_dataset(string path);
+bool parse_packed_header(const unsigned char *data, uint64_t file_size, PackedDatasetHeader &header);
+bool write_packed_dataset(string path, vector<uint64_t> items, uint8_t item_bits, bool sort_dedup);
+bool convert_csv_to_packed(string csv_path, string packed_path, bool sort_dedup);
+Dataset load_packed_dataset(string path, bool with_strings);
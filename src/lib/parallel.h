@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * Number of threads to use for `num_items` items
+ *
+ * @param num_items             Amount of work (items, bytes, ...)
+ * @param min_items_per_thread  Below this amount per thread, fewer threads are used
+ * @param num_threads           Requested threads, 0 = one per core
+ * */
+inline size_t choose_threads(size_t num_items, size_t min_items_per_thread, size_t num_threads)
+{
+    if(num_threads == 0)
+        num_threads = max(1U, thread::hardware_concurrency());
+    return max((size_t)1, min(num_threads, num_items / max((size_t)1, min_items_per_thread)));
+}
+
+
+/** Run `task(t)` for t in [0, num_threads), on num_threads - 1 new threads and the calling one */
+template <typename Task>
+void run_on_threads(size_t num_threads, Task task)
+{
+    vector<thread> threads;
+    for(size_t t = 1; t < num_threads; t++)
+        threads.emplace_back(task, t);
+    task(0);
+    for(thread &th : threads)
+        th.join();
+}
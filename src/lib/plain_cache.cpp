@@ -0,0 +1,137 @@
+/** Cache of the encoded sender set: encoding a sender value (or a row of bins) runs an inverse NTT, so a
+ *  restarted sender re-encoding a large dataset spends minutes before it can serve the first query. The
+ *  plaintexts are saved uncompressed in one file per dataset and parameter set, and a restarted sender
+ *  maps the file and loads each plaintext straight out of the mapping, which is a copy per plaintext.
+ *  Several sender processes loading the same file share its pages in the page cache.
+ * */
+
+
+
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+#include "file_store.h"
+#include "ingest.h"
+#include "plain_cache.h"
+#include "sender.h"
+
+using namespace std;
+using namespace seal;
+
+#define PLAIN_CACHE_AUDIT
+
+
+/**
+ * Path of the cache file of an encoded sender set
+ *
+ * @param cache_dir     Directory holding the cache files
+ * @param params        Encryption parameters the set is encoded with
+ * @param dataset_hash  Fingerprint of the encoded values
+ *
+ * @return              `cache_dir`/sender_plain_<dataset fingerprint>_<parms hash>.bin
+ * */
+string sender_plain_cache_path(string cache_dir, EncryptionParameters params, uint64_t dataset_hash)
+{
+    char name[72];
+    snprintf(name, sizeof(name), "sender_plain_%016llx_%016llx.bin", (unsigned long long)dataset_hash,
+            (unsigned long long)params.parms_id()[0]);
+    return cache_dir + "/" + name;
+}
+
+
+/**
+ * Save an encoded sender set, atomically (see `AtomicFileWriter`). The plaintexts are written one at a
+ * time, so the set is not copied in memory.
+ *
+ * @param path          Output path (see `sender_plain_cache_path`)
+ * @param params        Encryption parameters the set is encoded with
+ * @param dataset_hash  Fingerprint of the encoded values
+ * @param sender_plain  Encoded sender values
+ *
+ * @return              true on success
+ * */
+bool save_sender_plain(string path, EncryptionParameters params, uint64_t dataset_hash,
+        const vector<shared_ptr<const Plaintext>> &sender_plain)
+{
+    AtomicFileWriter writer;
+    if(!writer.open(path))
+        return false;
+
+    vector<seal_byte> buffer(sizeof(PlainCacheHeader));
+    unsigned char *out = (unsigned char *)buffer.data();
+    put_header_prefix(out, PLAIN_CACHE_MAGIC, PLAIN_CACHE_VERSION, sender_plain.size(), params.parms_id());
+    put_le(out, dataset_hash, 8);
+    put_le(out, 0, 8);
+    bool ok = writer.write(buffer.data(), buffer.size());
+
+    for(size_t index = 0; ok && index < sender_plain.size(); index++){
+        size_t size = sender_plain[index]->save_size(compr_mode_type::none);
+        buffer.resize(8 + size);
+        size = sender_plain[index]->save(buffer.data() + 8, size, compr_mode_type::none);
+        out = (unsigned char *)buffer.data();
+        put_le(out, size, 8);
+        ok = writer.write(buffer.data(), 8 + size);
+    }
+    return ok && writer.commit();
+}
+
+
+/**
+ * Load an encoded sender set saved by `save_sender_plain`
+ *
+ * @param path          Cache file path
+ * @param context       Context of the encryption parameters, used to validate the plaintexts
+ * @param params        Encryption parameters the set must be encoded with
+ * @param dataset_hash  Fingerprint of the values the set must encode
+ * @param sender_plain  Output, encoded sender values
+ *
+ * @return              true on a hit, false if the file is missing, invalid or made for another dataset
+ * */
+bool load_sender_plain(string path, const SEALContext &context, EncryptionParameters params, uint64_t dataset_hash,
+        vector<shared_ptr<const Plaintext>> &sender_plain)
+{
+    MappedFile file;
+    if(!map_existing_file(path, file, sizeof(PlainCacheHeader)))
+        return false;
+
+    const unsigned char *data = (const unsigned char *)file.getData();
+    size_t size = file.getSize();
+    uint64_t count = get_le(data, 8, 8);
+    if(!check_header_prefix(data, PLAIN_CACHE_MAGIC, PLAIN_CACHE_VERSION, params.parms_id()) ||
+            get_le(data, 48, 8) != dataset_hash || count > (size - sizeof(PlainCacheHeader)) / 8){
+#ifdef PLAIN_CACHE_AUDIT
+        printf("plain cache: %s is stale\n", path.c_str());
+#endif
+        return false;
+    }
+
+    vector<Plaintext> loaded(count);
+    size_t offset = sizeof(PlainCacheHeader);
+    try{
+        for(Plaintext &plain : loaded){
+            if(size - offset < 8 || get_le(data, offset, 8) > size - offset - 8){
+#ifdef PLAIN_CACHE_AUDIT
+                printf("plain cache: %s is truncated\n", path.c_str());
+#endif
+                return false;
+            }
+            uint64_t plain_size = get_le(data, offset, 8);
+            plain.load(context, (const seal_byte *)data + offset + 8, plain_size);
+            offset += 8 + plain_size;
+        }
+    }
+    catch (exception& e){
+#ifdef PLAIN_CACHE_AUDIT
+        printf("plain cache: invalid plaintext in %s\n", path.c_str());
+#endif
+        return false;
+    }
+    sender_plain = share_plaintexts(move(loaded));
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+
+using namespace std;
+using namespace seal;
+
+
+#define PLAIN_CACHE_MAGIC 0x45495350U       // "PSIE" in little-endian
+#define PLAIN_CACHE_VERSION 1
+
+
+/**
+ * Header of an encoded sender set file (64 bytes, little-endian), followed by `count` plaintexts, each
+ * stored as [size (8 bytes)][uncompressed SEAL serialization]
+ * */
+struct PlainCacheHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t count;                 // number of plaintexts (sender values or rows of bins)
+    parms_id_type parms_hash;       // `parms_id` of the encryption parameters
+    uint64_t dataset_hash;          // fingerprint of the encoded values, see `SenderService`
+    uint64_t reserved2;
+};
+
+
+string sender_plain_cache_path(string cache_dir, EncryptionParameters params, uint64_t dataset_hash);
+bool save_sender_plain(string path, EncryptionParameters params, uint64_t dataset_hash,
+        const vector<shared_ptr<const Plaintext>> &sender_plain);
+bool load_sender_plain(string path, const SEALContext &context, EncryptionParameters params, uint64_t dataset_hash,
+        vector<shared_ptr<const Plaintext>> &sender_plain);
@@ -0,0 +1,427 @@
+/** Cache of encrypted receiver queries: a receiver querying the same dataset again (another sender, or
+ *  the same one later) loads the ciphertexts of its previous query from disk instead of encoding and
+ *  encrypting the dataset again. The cache is keyed by the dataset, the encryption parameters and the
+ *  public key. Reusing a ciphertext as it is would let the senders link the queries, so the loaded
+ *  ciphertexts are re-randomized by adding a fresh encryption of zero, which costs one encryption of a
+ *  constant and an addition instead of an encoding and an encryption per chunk.
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "seal/seal.h"
+#include "file_store.h"
+#include "ingest.h"
+#include "item_hash.h"
+#include "query_cache.h"
+#include "receiver.h"
+
+using namespace std;
+using namespace seal;
+
+#define CACHE_AUDIT
+
+static const ItemHashKey FINGERPRINT_KEY = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+
+
+/**
+ * Fingerprint of the values of a dataset (order matters, since it decides the slot of each value)
+ * */
+uint64_t query_fingerprint(const vector<uint64_t> &values)
+{
+    return hash_item((const char *)values.data(), values.size() * sizeof(uint64_t), FINGERPRINT_KEY, 64);
+}
+
+
+/**
+ * Fingerprint of a public key: the cached ciphertexts can only be decrypted by the matching secret key
+ * */
+uint64_t public_key_fingerprint(const PublicKey &pk)
+{
+    vector<seal_byte> buffer(pk.save_size(compr_mode_type::none));
+    size_t size = pk.save(buffer.data(), buffer.size(), compr_mode_type::none);
+    return hash_item((const char *)buffer.data(), size, FINGERPRINT_KEY, 64);
+}
+
+
+/**
+ * Path of the cache file for the query of a receiver
+ *
+ * @param cache_dir     Directory holding the cache files
+ * @param params        Encryption parameters of the query
+ * @param recv          Receiver, holding its dataset and public key
+ *
+ * @return              `cache_dir`/query_<dataset fingerprint>_<parms hash>.bin
+ * */
+string query_cache_path(string cache_dir, EncryptionParameters params, const Receiver &recv)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "query_%016llx_%016llx.bin",
+            (unsigned long long)query_fingerprint(recv.getDataset().getLongDatasetRef()),
+            (unsigned long long)params.parms_id()[0]);
+    return cache_dir + "/" + name;
+}
+
+
+/**
+ * Save the ciphertexts of a query and its layout, atomically (see `write_file_atomic`)
+ *
+ * @param path      Output path (see `query_cache_path`)
+ * @param params    Encryption parameters of the query
+ * @param recv      Receiver that encrypted the query (dataset and public key)
+ * @param query     Ciphertexts, one per chunk of slot_count values
+ *
+ * @return          true on success
+ * */
+bool save_query_cache(string path, EncryptionParameters params, const Receiver &recv,
+        const vector<Ciphertext> &query)
+{
+    const vector<uint64_t> &layout = recv.getDataset().getLongDatasetRef();
+    size_t file_size = sizeof(QueryCacheHeader) + 8 + 8 * layout.size();
+    for(const Ciphertext &ct : query)
+        file_size += 8 + ct.save_size(compr_mode_type::none);
+    vector<seal_byte> buffer(file_size);
+
+    unsigned char *out = (unsigned char *)buffer.data();
+    put_header_prefix(out, QUERY_CACHE_MAGIC, QUERY_CACHE_VERSION, query.size(), params.parms_id());
+    put_le(out, query_fingerprint(layout), 8);
+    put_le(out, public_key_fingerprint(recv.getRecvPk()), 8);
+    for(const Ciphertext &ct : query){
+        unsigned char *size_field = out;
+        out += 8;
+        size_t size = ct.save((seal_byte *)out, file_size - (out - (unsigned char *)buffer.data()),
+                compr_mode_type::none);
+        put_le(size_field, size, 8);
+        out += size;
+    }
+    put_le(out, layout.size(), 8);
+    for(uint64_t value : layout)
+        put_le(out, value, 8);
+    return write_file_atomic(path, buffer.data(), out - (unsigned char *)buffer.data());
+}
+
+
+/**
+ * Read a query cache file made with the given parameters and public key
+ *
+ * @param path          Cache file path
+ * @param params        Encryption parameters of the query
+ * @param recv          Receiver: its public key must be the one the query was made with
+ * @param check_dataset Also require the cached query to be made of the receiver's current dataset
+ * @param query         Output, the ciphertexts
+ * @param layout        Output, the dataset values in slot order when the query was made
+ *
+ * @return              true if the file is a valid cache entry
+ * */
+static bool read_query_file(string path, EncryptionParameters params, const Receiver &recv, bool check_dataset,
+        vector<Ciphertext> &query, vector<uint64_t> &layout)
+{
+    MappedFile file;
+    if(!map_existing_file(path, file, sizeof(QueryCacheHeader)))
+        return false;
+
+    const unsigned char *data = (const unsigned char *)file.getData();
+    size_t size = file.getSize();
+    uint64_t count = get_le(data, 8, 8);
+    if(!check_header_prefix(data, QUERY_CACHE_MAGIC, QUERY_CACHE_VERSION, params.parms_id()) ||
+            count > (size - sizeof(QueryCacheHeader)) / 8 ||
+            (check_dataset && get_le(data, 48, 8) != query_fingerprint(recv.getDataset().getLongDatasetRef())) ||
+            get_le(data, 56, 8) != public_key_fingerprint(recv.getRecvPk())){
+#ifdef CACHE_AUDIT
+        printf("query cache: %s is stale\n", path.c_str());
+#endif
+        return false;
+    }
+
+    SEALContext context(params);
+    vector<Ciphertext> loaded(count);
+    size_t offset = sizeof(QueryCacheHeader);
+    bool valid = true;
+    try{
+        for(Ciphertext &ct : loaded){
+            if(size - offset < 8 || get_le(data, offset, 8) > size - offset - 8){
+                valid = false;
+                break;
+            }
+            uint64_t ct_size = get_le(data, offset, 8);
+            ct.load(context, (const seal_byte *)data + offset + 8, ct_size);
+            offset += 8 + ct_size;
+        }
+    }
+    catch (exception& e){
+#ifdef CACHE_AUDIT
+        printf("query cache: invalid ciphertext in %s\n", path.c_str());
+#endif
+        return false;
+    }
+
+    uint64_t num_items = (valid && size - offset >= 8) ? get_le(data, offset, 8) : 0;
+    if(!valid || size - offset < 8 || num_items > (size - offset - 8) / 8){
+#ifdef CACHE_AUDIT
+        printf("query cache: %s is truncated\n", path.c_str());
+#endif
+        return false;
+    }
+    layout.resize(num_items);
+    for(uint64_t index = 0; index < num_items; index++)
+        layout[index] = get_le(data, offset + 8 + 8 * index, 8);
+    query = move(loaded);
+    return true;
+}
+
+
+/**
+ * Load the ciphertexts of a cached query
+ *
+ * @param path      Cache file path
+ * @param params    Encryption parameters of the query
+ * @param recv      Receiver: its dataset and public key must be the ones the query was made with
+ * @param query     Output, the ciphertexts
+ *
+ * @return          true on a hit, false if there is no valid cache entry for this query
+ * */
+bool load_query_cache(string path, EncryptionParameters params, const Receiver &recv, vector<Ciphertext> &query)
+{
+    vector<uint64_t> layout;
+    return read_query_file(path, params, recv, true, query, layout);
+}
+
+
+/**
+ * Re-randomize the ciphertexts of a query by adding a fresh encryption of zero to each of them: the
+ * plaintexts do not change, but the ciphertexts cannot be linked to the previous uses of the query
+ *
+ * @param query     Ciphertexts, modified in place
+ * @param params    Encryption parameters of the query
+ * @param recv      Receiver, holding the public key
+ * @param pool      Threads used to encrypt the zeros
+ * */
+void rerandomize_query(vector<Ciphertext> &query, EncryptionParameters params, const Receiver &recv,
+        ThreadPool &pool)
+{
+    SEALContext context(params);
+    Evaluator evaluator(context);
+    vector<unique_ptr<Encryptor>> encryptors(pool.getNumThreads());
+    vector<MemoryPoolHandle> memory_pools(pool.getNumThreads());
+    pool.parallel_for(query.size(), [&](size_t chunk, size_t worker){
+        if(!encryptors[worker]){
+            encryptors[worker] = make_unique<Encryptor>(context, recv.getRecvPk());
+            memory_pools[worker] = MemoryPoolHandle::New();
+        }
+        Ciphertext zero;
+        encryptors[worker]->encrypt_zero(zero, memory_pools[worker]);
+        evaluator.add_inplace(query[chunk], zero);
+    });
+}
+
+
+/**
+ * Encrypted query of a receiver, in chunks of slot_count values (see `crypt_dataset_chunks`): on a
+ * cache hit the cached ciphertexts are re-randomized and returned, otherwise the dataset is encrypted
+ * and the ciphertexts are saved for the next runs
+ *
+ * @param recv              Receiver, holding its keys and dataset
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param cache_dir         Directory holding the cache files
+ * @param pool              Threads used to encrypt
+ *
+ * @return                  The ciphertexts, one per chunk of the dataset
+ * */
+vector<Ciphertext> crypt_dataset_cached(const Receiver &recv, size_t poly_mod_degree, string cache_dir,
+        ThreadPool &pool)
+{
+    EncryptionParameters params = get_params(poly_mod_degree);
+    string path = query_cache_path(cache_dir, params, recv);
+    vector<Ciphertext> query;
+    if(load_query_cache(path, params, recv, query)){
+        rerandomize_query(query, params, recv, pool);
+#ifdef CACHE_AUDIT
+        printf("query cache: %zu ciphertexts loaded from %s\n", query.size(), path.c_str());
+#endif
+        return query;
+    }
+
+    crypt_dataset_chunks(recv, poly_mod_degree, pool, [&query](size_t, const Ciphertext &ct){
+        query.push_back(ct);
+        return true;
+    });
+    if(query.size() > 0 && !save_query_cache(path, params, recv, query)){
+#ifdef CACHE_AUDIT
+        printf("query cache: cannot save the query in %s\n", path.c_str());
+#endif
+    }
+    return query;
+}
+
+
+/**
+ * Place the values of a new version of a dataset in the slots of the previous one, so that as few chunks
+ * as possible change: values still present keep their slot, new values fill the slots freed by the
+ * removed ones and then go after the last slot; if more values were removed than added, the holes left
+ * are filled with the last values. The chunks that change are thus proportional to the churn.
+ *
+ * @param previous  Values of the previous version, in slot order
+ * @param values    Values of the new version
+ *
+ * @return          For each slot of the new layout, the index in `values` of the value it holds
+ * */
+vector<size_t> plan_delta_layout(const vector<uint64_t> &previous, const vector<uint64_t> &values)
+{
+    // Indices of each new value, the first one at the back (duplicates get one slot each)
+    unordered_map<uint64_t, vector<size_t>> positions;
+    positions.reserve(values.size());
+    for(size_t index = values.size(); index-- > 0;)
+        positions[values[index]].push_back(index);
+
+    const int64_t HOLE = -1;
+    vector<int64_t> slots(previous.size(), HOLE);
+    for(size_t slot = 0; slot < previous.size(); slot++){
+        auto it = positions.find(previous[slot]);
+        if(it != positions.end() && !it->second.empty()){
+            slots[slot] = it->second.back();
+            it->second.pop_back();
+        }
+    }
+
+    vector<size_t> added;
+    for(auto &entry : positions)
+        added.insert(added.end(), entry.second.begin(), entry.second.end());
+    sort(added.begin(), added.end());
+    size_t hole = 0;
+    for(size_t index : added){
+        while(hole < slots.size() && slots[hole] != HOLE)
+            hole++;
+        if(hole < slots.size())
+            slots[hole] = index;
+        else
+            slots.push_back(index);
+    }
+
+    // Fill the remaining holes with the last values
+    hole = 0;
+    while(true){
+        while(!slots.empty() && slots.back() == HOLE)
+            slots.pop_back();
+        while(hole < slots.size() && slots[hole] != HOLE)
+            hole++;
+        if(hole >= slots.size())
+            break;
+        slots[hole] = slots.back();
+        slots.pop_back();
+    }
+    return vector<size_t>(slots.begin(), slots.end());
+}
+
+
+/**
+ * Encrypted query of a receiver whose dataset changed a little since its previous query, saved in
+ * `cache_path` (by a previous call, with the same parameters and keys): the dataset is reordered with
+ * `plan_delta_layout`, the chunks whose values did not change are taken from the cache and only
+ * re-randomized, and only the changed chunks are encoded and encrypted. The new query replaces the
+ * previous one in the cache. Without a valid cache entry every chunk is encrypted.
+ *
+ * @param recv              Receiver, holding its keys and dataset; the dataset is reordered in the
+ *                          slot order of the query, so that the intersection refers to it
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param cache_path        Cache file of the receiver's queries
+ * @param pool              Threads used to encrypt
+ * @param stats             Output, if not nullptr the chunks encrypted and reused
+ *
+ * @return                  The ciphertexts, one per chunk of the (reordered) dataset
+ * */
+vector<Ciphertext> crypt_dataset_delta(Receiver &recv, size_t poly_mod_degree, string cache_path, ThreadPool &pool,
+        QueryDeltaStats *stats)
+{
+    EncryptionParameters params = get_params(poly_mod_degree);
+    SEALContext context(params);
+    BatchEncoder encoder(context);
+    Evaluator evaluator(context);
+    size_t slot_count = encoder.slot_count();
+
+    vector<Ciphertext> previous_query;
+    vector<uint64_t> previous_layout;
+    if(!read_query_file(cache_path, params, recv, false, previous_query, previous_layout))
+        previous_query.clear();
+
+    // Reorder the dataset in the slot order of the new query
+    const Dataset &dataset = recv.getDataset();
+    const vector<uint64_t> &values = dataset.getLongDatasetRef();
+    const ItemStore &items = dataset.getItemStore();
+    vector<size_t> order = plan_delta_layout(previous_query.empty() ? vector<uint64_t>() : previous_layout, values);
+    vector<uint64_t> layout(order.size());
+    ItemStore layout_items;
+    bool with_items = items.size() == values.size();
+    layout_items.reserve(with_items ? order.size() : 0, with_items ? items.getCharCount() : 0);
+    for(size_t slot = 0; slot < order.size(); slot++){
+        layout[slot] = values[order[slot]];
+        if(with_items)
+            layout_items.push_back(items[order[slot]]);
+    }
+    Dataset reordered;
+    reordered.setSigmaLength(dataset.getSigmaLength());
+    reordered.setLongDataset(move(layout));
+    reordered.setItemStore(move(layout_items));
+    recv.setDataset(move(reordered));
+
+    const vector<uint64_t> &slot_values = recv.getDataset().getLongDatasetRef();
+    size_t num_chunks = (slot_values.size() + slot_count - 1) / slot_count;
+    vector<Ciphertext> query(num_chunks);
+    vector<char> reuse(num_chunks, 0);
+    for(size_t chunk = 0; chunk < num_chunks && chunk < previous_query.size(); chunk++){
+        size_t first = chunk * slot_count;
+        size_t last = min(slot_values.size(), first + slot_count);
+        size_t previous_last = min(previous_layout.size(), first + slot_count);
+        reuse[chunk] = previous_last == last && equal(slot_values.begin() + first, slot_values.begin() + last, 
+                previous_layout.begin() + first);
+        if(reuse[chunk])
+            query[chunk] = move(previous_query[chunk]);
+    }
+
+    vector<unique_ptr<Encryptor>> encryptors(pool.getNumThreads());
+    vector<MemoryPoolHandle> memory_pools(pool.getNumThreads());
+    pool.parallel_for(num_chunks, [&](size_t chunk, size_t worker){
+        if(!encryptors[worker]){
+            encryptors[worker] = make_unique<Encryptor>(context, recv.getRecvPk());
+            memory_pools[worker] = MemoryPoolHandle::New();
+        }
+        if(reuse[chunk]){
+            Ciphertext zero;
+            encryptors[worker]->encrypt_zero(zero, memory_pools[worker]);
+            evaluator.add_inplace(query[chunk], zero);
+            return;
+        }
+        size_t first = chunk * slot_count;
+        size_t last = min(slot_values.size(), first + slot_count);
+        vector<uint64_t> chunk_matrix(slot_count, 0ULL);
+        copy(slot_values.begin() + first, slot_values.begin() + last, chunk_matrix.begin());
+        Plaintext plain_chunk;
+        encoder.encode(chunk_matrix, plain_chunk);
+        encryptors[worker]->encrypt(plain_chunk, query[chunk], memory_pools[worker]);
+    });
+
+    size_t reused = count(reuse.begin(), reuse.end(), 1);
+    if(num_chunks > 0 && !save_query_cache(cache_path, params, recv, query)){
+#ifdef CACHE_AUDIT
+        printf("query cache: cannot save the query in %s\n", cache_path.c_str());
+#endif
+    }
+#ifdef CACHE_AUDIT
+    printf("query cache: %zu chunks encrypted, %zu reused\n", num_chunks - reused, reused);
+#endif
+    if(stats != nullptr){
+        stats->chunks = num_chunks;
+        stats->reencrypted = num_chunks - reused;
+        stats->reused = reused;
+    }
+    return query;
+}
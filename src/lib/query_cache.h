@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+using namespace std;
+using namespace seal;
+
+
+#define QUERY_CACHE_MAGIC 0x51495350U       // "PSIQ" in little-endian
+#define QUERY_CACHE_VERSION 2
+
+
+/**
+ * Header of an encrypted query cache file (64 bytes, little-endian), followed by `count` ciphertexts,
+ * each stored as [size (8 bytes)][uncompressed SEAL serialization], and by the layout of the query:
+ * [number of items (8 bytes)][the dataset values in slot order, 8 bytes each]
+ * */
+struct QueryCacheHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t count;                 // number of ciphertexts (chunks of the dataset)
+    parms_id_type parms_hash;       // `parms_id` of the encryption parameters
+    uint64_t dataset_hash;          // see `query_fingerprint`
+    uint64_t key_hash;
+};
+
+
+/** Work done by `crypt_dataset_delta` */
+struct QueryDeltaStats
+{
+    size_t chunks = 0;
+    size_t reencrypted = 0;         // chunks whose values changed
+    size_t reused = 0;              // cached chunks, only re-randomized
+};
+
+
+uint64_t query_fingerprint(const vector<uint64_t> &values);
+uint64_t public_key_fingerprint(const PublicKey &pk);
+string query_cache_path(string cache_dir, EncryptionParameters params, const Receiver &recv);
+bool save_query_cache(string path, EncryptionParameters params, const Receiver &recv,
+        const vector<Ciphertext> &query);
+bool load_query_cache(string path, EncryptionParameters params, const Receiver &recv, vector<Ciphertext> &query);
+void rerandomize_query(vector<Ciphertext> &query, EncryptionParameters params, const Receiver &recv,
+        ThreadPool &pool);
+vector<Ciphertext> crypt_dataset_cached(const Receiver &recv, size_t poly_mod_degree, string cache_dir,
+        ThreadPool &pool);
+vector<size_t> plan_delta_layout(const vector<uint64_t> &previous, const vector<uint64_t> &values);
+vector<Ciphertext> crypt_dataset_delta(Receiver &recv, size_t poly_mod_degree, string cache_path, ThreadPool &pool,
+        QueryDeltaStats *stats = nullptr);
@@ -12,13 +12,28 @@
 #include <iostream>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <list>
 #include <cmath>
 #include <vector>
 #include <bitset>
 #include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <exception>
+#include <future>
+#include <thread>
 
 #include "utils.h"
+#include "chunk_reader.h"
+#include "hashing.h"
+#include "thread_pool.h"
+#include "transport.h"
+#include "zero_scan.h"
 #include "seal/seal.h"
 
 using namespace std;
@@ -27,8 +42,8 @@ using namespace seal;
 #define RECV_AUDIT
 
 // Function prototypes
-void print_intersection(vector<string> intersection);
-void write_result_on_file(vector<string> intersection);
+void print_intersection(const IntersectionBitmap &matches, const ItemStore &items);
+void write_result_on_file(const IntersectionBitmap &matches, const ItemStore &items);
 
 
 /** 
@@ -40,10 +55,10 @@ void write_result_on_file(vector<string> intersection);
  *
  * @return                  A [matrix] Ciphertext that contains the ecnrypted values of the dataset
  * */
-Ciphertext crypt_dataset(Receiver recv, size_t poly_mod_degree)
+Ciphertext crypt_dataset(const Receiver &recv, size_t poly_mod_degree)
 {   
 	Ciphertext encrypted_recv_matrix;
-	vector<uint64_t> longint_recv_dataset = recv.getDataset().getLongDataset();
+	const vector<uint64_t> &longint_recv_dataset = recv.getDataset().getLongDatasetRef();
 
 	if (longint_recv_dataset.size() == 0){
 #ifdef RECV_AUDIT
@@ -85,19 +100,170 @@ Ciphertext crypt_dataset(Receiver recv, size_t poly_mod_degree)
 
 
 /** 
- * Last part of the PSI scheme, where the receiver computes the intersection between the two dataset.
+ * Encrypt the receiver's dataset while reading it: the file is read in chunks of slot_count values and
+ * each chunk is encoded in its own ciphertext, handed to `consumer` (e.g. to send it) before the next 
+ * chunk is read. Memory stays bounded by one chunk, whatever the size of the dataset.
  * 
- * @param poly_mod_degree       size of the polynomial modulus (bits), used to configure the parameters
+ * @param dataset_path      Path of the receiver dataset (bitstring CSV or packed binary format)
+ * @param recv              Instance of Receiver class, holding the public key
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param consumer          Called with each ciphertext and the chunk of the dataset it encrypts
+ *
+ * @return                  Number of ciphertexts produced
+ * */
+size_t stream_encrypt_dataset(string dataset_path, const Receiver &recv, size_t poly_mod_degree, 
+        function<void(const Ciphertext &, const Dataset &)> consumer)
+{
+    EncryptionParameters params = get_params(poly_mod_degree);
+	SEALContext recv_context(params);
+	Encryptor encryptor(recv_context, recv.getRecvPk());
+	BatchEncoder encoder(recv_context);
+	size_t slot_count = encoder.slot_count();
+
+	DatasetChunkReader reader;
+	if(!reader.open(dataset_path, slot_count))
+		return 0;
+
+	size_t num_chunks = 0;
+	Dataset chunk;
+	Plaintext plain_chunk;
+	Ciphertext encrypted_chunk;
+	vector<uint64_t> chunk_matrix(slot_count);
+	while(reader.next_chunk(chunk)){
+		const vector<uint64_t> &values = chunk.getLongDatasetRef();
+		fill(copy(values.begin(), values.end(), chunk_matrix.begin()), chunk_matrix.end(), 0ULL);
+		encoder.encode(chunk_matrix, plain_chunk);
+		encryptor.encrypt(plain_chunk, encrypted_chunk);
+		consumer(encrypted_chunk, chunk);
+		num_chunks++;
+	}
+
+#ifdef RECV_AUDIT
+	printf("First step completed: %zu values in %zu ciphertexts\n", reader.getItemsRead(), num_chunks);
+#endif
+	return num_chunks;
+}
+
+
+/**
+ * Encrypt the receiver's dataset in chunks of slot_count values (as `stream_encrypt_dataset` does),
+ * encoding and encrypting the chunks in parallel, each worker with its own encryptor and SEAL memory
+ * pool. The ciphertexts are handed to `consumer` in order on the calling thread as soon as they are
+ * ready, while the workers encrypt the following chunks: sending chunk k overlaps with encrypting
+ * chunk k + 1, and at most two chunks per worker are held in memory.
+ *
+ * @param recv              Instance of Receiver class
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param pool              Threads used to encode and encrypt
+ * @param consumer          Called with the index of each chunk and its ciphertext; returning false stops
+ *                          the encryption
+ *
+ * @return                  Number of ciphertexts accepted by the consumer
+ * */
+size_t crypt_dataset_chunks(const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool,
+        function<bool(size_t, const Ciphertext &)> consumer)
+{
+	const vector<uint64_t> &longint_recv_dataset = recv.getDataset().getLongDatasetRef();
+    EncryptionParameters params = get_params(poly_mod_degree);
+	SEALContext recv_context(params);
+	BatchEncoder encoder(recv_context);
+	size_t slot_count = encoder.slot_count();
+	size_t num_chunks = (longint_recv_dataset.size() + slot_count - 1) / slot_count;
+
+	vector<unique_ptr<Encryptor>> encryptors(pool.getNumThreads());
+	vector<MemoryPoolHandle> memory_pools(pool.getNumThreads());
+	auto encrypt_chunk = [&](size_t chunk){
+		size_t worker = ThreadPool::current_worker();
+		if(!encryptors[worker]){
+			encryptors[worker] = make_unique<Encryptor>(recv_context, recv.getRecvPk());
+			memory_pools[worker] = MemoryPoolHandle::New();
+		}
+		auto first = longint_recv_dataset.begin() + chunk * slot_count;
+		auto last = longint_recv_dataset.begin() + min(longint_recv_dataset.size(), (chunk + 1) * slot_count);
+		vector<uint64_t> chunk_matrix(slot_count, 0ULL);
+		copy(first, last, chunk_matrix.begin());
+
+		Plaintext plain_chunk;
+		Ciphertext encrypted_chunk;
+		encoder.encode(chunk_matrix, plain_chunk);
+		encryptors[worker]->encrypt(plain_chunk, encrypted_chunk, memory_pools[worker]);
+		return encrypted_chunk;
+	};
+
+	// Keep two chunks per worker in flight, so that the workers never wait for the consumer
+	size_t window = 2 * pool.getNumThreads();
+	deque<future<Ciphertext>> pending;
+	size_t submitted = 0, consumed = 0;
+	bool stopped = false;
+	exception_ptr error;
+	while(consumed < num_chunks && !stopped){
+		for(; submitted < num_chunks && pending.size() < window; submitted++)
+			pending.push_back(pool.submit([&encrypt_chunk, submitted](){ return encrypt_chunk(submitted); }));
+
+		try{
+			Ciphertext encrypted_chunk = pending.front().get();
+			stopped = !consumer(consumed, encrypted_chunk);
+		}
+		catch(...){
+			error = current_exception();
+			stopped = true;
+		}
+		pending.pop_front();
+		if(!stopped)
+			consumed++;
+	}
+
+	// The queued tasks reference this frame: wait for them before leaving it
+	for(future<Ciphertext> &task : pending)
+		task.wait();
+	if(error)
+		rethrow_exception(error);
+
+#ifdef RECV_AUDIT
+	printf("First step completed: %zu values in %zu ciphertexts\n", longint_recv_dataset.size(), consumed);
+#endif
+	return consumed;
+}
+
+
+/**
+ * Encrypt the receiver's dataset in parallel with `crypt_dataset_chunks` and send each ciphertext as
+ * soon as it is ready, so that the first chunks are on their way while the next ones are encrypted.
+ * The last ciphertext is followed by an end of stream marker.
+ *
+ * @param transport         Transport used to reach the sender
+ * @param recv              Instance of Receiver class
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param pool              Threads used to encode and encrypt
+ *
+ * @return                  true if all the ciphertexts were sent
+ * */
+bool send_encrypted_dataset(Transport &transport, const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool)
+{
+	size_t num_items = recv.getDataset().getLongDatasetRef().size();
+	size_t slot_count = poly_mod_degree;
+	size_t sent = crypt_dataset_chunks(recv, poly_mod_degree, pool, [&transport](size_t, const Ciphertext &ct){
+		return send_ciphertext(transport, ct);
+	});
+	return sent == (num_items + slot_count - 1) / slot_count && send_end_of_stream(transport);
+}
+
+
+/** 
+ * Decrypt the sender's result and collect the receiver's items whose slot is zero
+ * 
+ * @param params                Parameters of the scheme
  * @param sender_computation    Ciphertext resulting after the homomorphic computation performed by the sender
  * @param recv                  Receiver class instance containing the secret key used to decrypt
+ * @param bin_items             Item of each slot when the items are binned, nullptr if item i is in slot i
  * 
  * @return                      Result of the computation
  * */
-ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sender_computation, Receiver recv)
+static ComputationResult decrypt_and_match(EncryptionParameters params, Ciphertext sender_computation, 
+        const Receiver &recv, const vector<int64_t> *bin_items)
 {
-	vector<string> intersection;
 	size_t noise = 0;
-	ComputationResult result(noise, intersection);
+	ComputationResult result(noise);
 
 	if(sender_computation.size() == 0){
 #ifdef RECV_AUDIT
@@ -106,7 +272,6 @@ ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sende
         return result;
 	}
 
-    EncryptionParameters params = get_params(poly_mod_degree);
 	SEALContext recv_context(params);
 	Decryptor recv_decryptor(recv_context, recv.getRecvSk());	
 	Plaintext plain_result;
@@ -118,34 +283,269 @@ ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sende
 #endif
 
 	BatchEncoder encoder(recv_context);
-	long size = recv.getDataset().getSigmaLength();
-    vector<uint64_t> recv_dataset = recv.getDataset().getLongDataset();
+	const Dataset &recv_dataset = recv.getDataset();
+	IntersectionBitmap matches(recv_dataset.getLongDatasetRef().size());
 	
     // Decrypt and decode the received matrix
 	recv_decryptor.decrypt(sender_computation, plain_result);
 	encoder.decode(plain_result, pod_result);
     
-	for(long index = 0; index < recv_dataset.size(); index++)
-		if(pod_result[index] == 0)									// the value belongs to the intersection
-			intersection.push_back(recv.getDataset().getStringDataset()[index]);
+	/* The values that belong to the intersection are the zero slots: a single ciphertext holds at most
+	 * one value per slot, the items after the last slot are not part of the query */
+	if(bin_items == nullptr)
+		zero_scan(pod_result.data(), min(matches.size(), pod_result.size()), matches.getWords());
+	else{
+		IntersectionBitmap zero_bins(bin_items->size());
+		zero_scan(pod_result.data(), min(zero_bins.size(), pod_result.size()), zero_bins.getWords());
+		zero_bins.for_each([&](size_t bin){
+			if((*bin_items)[bin] >= 0)
+				matches.set((*bin_items)[bin]);
+		});
+	}
 #ifdef RECV_AUDIT	
     printf("Last step completed\n");
 #endif
 
-    if(intersection.size() > 0)
-        print_intersection(intersection);
+    if(matches.count() > 0)
+        print_intersection(matches, recv_dataset.getItemStore());
 	else
 		printf("The intersection between sender and receiver is null \n");
 	
-	result.setIntersection(intersection);
+	result.setMatches(move(matches));
 	result.setNoiseBudget(recv_decryptor.invariant_noise_budget(sender_computation));
 	
-    //write_result_on_file(intersection);
+    //write_result_on_file(result.getMatches(), recv_dataset.getItemStore());
     
     return result;
 }
 
 
+/** 
+ * Last part of the PSI scheme, where the receiver computes the intersection between the two dataset.
+ * 
+ * @param poly_mod_degree       size of the polynomial modulus (bits), used to configure the parameters
+ * @param sender_computation    Ciphertext resulting after the homomorphic computation performed by the sender
+ * @param recv                  Receiver class instance containing the secret key used to decrypt
+ * 
+ * @return                      Result of the computation
+ * */
+ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sender_computation, 
+        const Receiver &recv)
+{
+	return decrypt_and_match(get_params(poly_mod_degree), sender_computation, recv, nullptr);
+}
+
+
+/**
+ * Decryption of the ciphertexts of a multi-ciphertext response, shared by the workers of a thread pool:
+ * response k holds the result for the items [k * slot_count, (k + 1) * slot_count) of the receiver 
+ * dataset (the chunks of `stream_encrypt_dataset`). Each worker gets its own decryptor and SEAL memory
+ * pool on first use; since a chunk covers whole bitmap words, each of them writes its part of the 
+ * intersection bitmap directly.
+ * */
+class ChunkDecryption
+{
+    public:
+        ChunkDecryption(EncryptionParameters params, const Receiver &recv, size_t num_workers)
+            : context(params), encoder(context), recv(recv), decryptors(num_workers), memory_pools(num_workers),
+              matches(recv.getDataset().getLongDatasetRef().size())
+        {
+            this->slot_count = this->encoder.slot_count();
+        }
+
+        size_t num_chunks(){ return (this->matches.size() + this->slot_count - 1) / this->slot_count; }
+
+        /** Decrypt response `chunk` on worker `worker`, and return its noise budget */
+        int decrypt(size_t chunk, const Ciphertext &response, size_t worker)
+        {
+            if(!this->decryptors[worker]){
+                this->decryptors[worker] = make_unique<Decryptor>(this->context, this->recv.getRecvSk());
+                this->memory_pools[worker] = MemoryPoolHandle::New();
+            }
+            size_t first = chunk * this->slot_count;
+            if(first >= this->matches.size() || response.size() == 0)
+                return 0;
+
+            Plaintext plain_result;
+            vector<uint64_t> pod_result;
+            this->decryptors[worker]->decrypt(response, plain_result);
+            this->encoder.decode(plain_result, pod_result, this->memory_pools[worker]);
+            zero_scan(pod_result.data(), min(this->slot_count, this->matches.size() - first), 
+                    this->matches.getWords() + first / 64);
+            return this->decryptors[worker]->invariant_noise_budget(response);
+        }
+
+        /** Result of the query, once all the chunks are decrypted */
+        ComputationResult result(const vector<int> &noise_budgets)
+        {
+#ifdef RECV_AUDIT	
+            printf("Last step completed: %zu ciphertexts decrypted\n", noise_budgets.size());
+#endif
+            if(this->matches.count() > 0)
+                print_intersection(this->matches, this->recv.getDataset().getItemStore());
+            else
+                printf("The intersection between sender and receiver is null \n");
+
+            ComputationResult result(*min_element(noise_budgets.begin(), noise_budgets.end()));
+            result.setMatches(move(this->matches));
+            return result;
+        }
+
+    private:
+        SEALContext context;
+        BatchEncoder encoder;
+        const Receiver &recv;
+        vector<unique_ptr<Decryptor>> decryptors;
+        vector<MemoryPoolHandle> memory_pools;
+        IntersectionBitmap matches;
+        size_t slot_count;
+};
+
+
+/** 
+ * Compute the intersection from a response made of several ciphertexts, one per chunk of the receiver
+ * dataset (see `ChunkDecryption`). The ciphertexts are decrypted and decoded in parallel.
+ * 
+ * @param poly_mod_degree       size of the polynomial modulus (bits), used to configure the parameters
+ * @param responses             Ciphertexts resulting from the sender computation, one per chunk
+ * @param recv                  Receiver class instance containing the secret key and the whole dataset
+ * @param pool                  Threads used to decrypt and decode
+ * 
+ * @return                      Result of the computation, the noise budget is the lowest of the chunks
+ * */
+ComputationResult decrypt_and_intersect_chunks(size_t poly_mod_degree, const vector<Ciphertext> &responses, 
+        const Receiver &recv, ThreadPool &pool)
+{
+	ChunkDecryption decryption(get_params(poly_mod_degree), recv, pool.getNumThreads());
+	if(responses.size() == 0 || responses.size() != decryption.num_chunks()){
+#ifdef RECV_AUDIT
+        printf("Missing or extra ciphertexts in the sender response\n");
+#endif
+        return ComputationResult(0);
+	}
+
+	// One budget per chunk of the dataset: the lowest one is the noise budget of the result
+	vector<int> noise_budgets(decryption.num_chunks(), 0);
+	pool.parallel_for(noise_budgets.size(), [&](size_t chunk, size_t worker){
+		noise_budgets[chunk] = decryption.decrypt(chunk, responses[chunk], worker);
+	});
+	return decryption.result(noise_budgets);
+}
+
+
+/** 
+ * Run a whole query against a sender serving it as a stream (see `SenderService::serve_stream`): the
+ * dataset is encrypted and sent with `send_encrypted_dataset` by a separate thread, while the responses
+ * are received and each of them is decrypted by the pool as soon as it arrives. Encryption, transfer,
+ * the sender evaluation and decryption of different chunks all overlap.
+ * 
+ * @param transport             Transport connected to the sender
+ * @param recv                  Receiver class instance containing the keys and the whole dataset
+ * @param poly_mod_degree       size of the polynomial modulus (bits), used to configure the parameters
+ * @param pool                  Threads used to encrypt and decrypt
+ * 
+ * @return                      Result of the computation, without matches if the sender did not answer 
+ *                              every chunk
+ * */
+ComputationResult stream_query(Transport &transport, const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool)
+{
+	EncryptionParameters params = get_params(poly_mod_degree);
+	SEALContext recv_context(params);
+	ChunkDecryption decryption(params, recv, pool.getNumThreads());
+	bool sent = false;
+	thread sending([&](){ sent = send_encrypted_dataset(transport, recv, poly_mod_degree, pool); });
+
+	vector<future<int>> noise_budgets;
+	bool complete = false;
+	while(true){
+		auto response = make_shared<Ciphertext>();
+		bool end_of_stream = false;
+		if(!receive_ciphertext(transport, recv_context, *response, end_of_stream))
+			break;
+		if(end_of_stream){
+			complete = true;
+			break;
+		}
+		size_t chunk = noise_budgets.size();
+		noise_budgets.push_back(pool.submit([&decryption, response, chunk](){ 
+			return decryption.decrypt(chunk, *response, ThreadPool::current_worker()); 
+		}));
+	}
+	sending.join();
+
+	vector<int> budgets;
+	for(future<int> &budget : noise_budgets)
+		budgets.push_back(budget.get());
+	if(!sent || !complete || budgets.size() == 0 || budgets.size() != decryption.num_chunks()){
+#ifdef RECV_AUDIT
+        printf("Missing or extra ciphertexts in the sender response\n");
+#endif
+        return ComputationResult(0);
+	}
+	return decryption.result(budgets);
+}
+
+
+/** 
+ * Encrypt the receiver's dataset placed in bins with cuckoo hashing (see `hashing.h`): each slot holds
+ * the stored value of the item of its bin. The receiver keys must be generated with 
+ * `get_params(poly_mod_degree, binning_plain_bits(binning))`.
+ * 
+ * @param recv              Instance of Receiver class
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param binning           Binning parameters shared with the sender
+ * @param bin_items         Output, index of the item of each bin (-1 for empty bins), needed to decrypt
+ *
+ * @return                  The ciphertext, empty if the dataset is empty or does not fit in the bins
+ * */
+Ciphertext crypt_dataset_binned(const Receiver &recv, size_t poly_mod_degree, const BinningParams &binning, 
+        vector<int64_t> &bin_items)
+{
+	Ciphertext encrypted_recv_matrix;
+	vector<uint64_t> bin_values;
+	if(recv.getDataset().getLongDatasetRef().size() == 0 || 
+			!cuckoo_hash(recv.getDataset().getLongDatasetRef(), binning, bin_values, bin_items)){
+#ifdef RECV_AUDIT
+		printf("Receiver dataset is empty or cannot be binned\n");
+#endif
+		return encrypted_recv_matrix;
+	}
+
+    EncryptionParameters params = get_params(poly_mod_degree, binning_plain_bits(binning));
+	SEALContext recv_context(params);
+	Encryptor encryptor(recv_context, recv.getRecvPk());
+	BatchEncoder recv_batch_encoder(recv_context);
+	Plaintext plain_recv_matrix;
+
+	recv_batch_encoder.encode(bin_values, plain_recv_matrix);
+	encryptor.encrypt(plain_recv_matrix, encrypted_recv_matrix);
+
+#ifdef RECV_AUDIT
+	printf("First step completed\n");
+#endif
+	return encrypted_recv_matrix;
+}
+
+
+/** 
+ * Same as `decrypt_and_intersect`, for a query encrypted with `crypt_dataset_binned`
+ * 
+ * @param poly_mod_degree       size of the polynomial modulus (bits), used to configure the parameters
+ * @param binning               Binning parameters shared with the sender
+ * @param sender_computation    Ciphertext resulting after the homomorphic computation performed by the sender
+ * @param recv                  Receiver class instance containing the secret key used to decrypt
+ * @param bin_items             Index of the item of each bin, as returned by `crypt_dataset_binned`
+ * 
+ * @return                      Result of the computation
+ * */
+ComputationResult decrypt_and_intersect_binned(size_t poly_mod_degree, const BinningParams &binning, 
+        Ciphertext sender_computation, const Receiver &recv, const vector<int64_t> &bin_items)
+{
+	return decrypt_and_match(get_params(poly_mod_degree, binning_plain_bits(binning)), sender_computation, 
+            recv, &bin_items);
+}
+
+
 /** 
  * Generate public and secret keys for recevier operations and relinearization keys that will be used by
  * sender
@@ -179,16 +579,17 @@ Receiver setup_pk_sk(EncryptionParameters params)
 /** 
  * Print the intersection between the dataset, in bistring and int formats 
  *
- * @param Intersection Intersection between the two dataset
+ * @param matches   Positions of the receiver dataset in the intersection
+ * @param items     Strings of the receiver dataset
  * */
-void print_intersection(vector<string> intersection)
+void print_intersection(const IntersectionBitmap &matches, const ItemStore &items)
 {
 	string o_line = "";
 	string v_line = " | ";
 	string spaces = "";
 	size_t i = 0;
 
-	int middle_point = intersection[0].length()+2;
+	int middle_point = items[matches.first()].size()+2;
 	long line_size = 2*middle_point;
 
 	for (i = 0; i <= line_size; i++)
@@ -197,30 +598,92 @@ void print_intersection(vector<string> intersection)
 	
 	cout << "\nPrinting the intersection between the two datasets: (bitstring, integer value)\n" << endl;
 	cout << o_line << endl;
-	for (string s : intersection){
-		cout << ' ' <<  s << v_line << stoull(s, 0, 2) << endl;
+	matches.for_each([&](size_t index){
+		string_view s = items[index];
+		// Hashed items (see `load_hashed_dataset`) are arbitrary strings, without an integer value
+		if(s.size() > 0 && s.size() <= 64 && s.find_first_not_of("01") == string_view::npos)
+			cout << ' ' <<  s << v_line << stoull(string(s), 0, 2) << endl;
+		else
+			cout << ' ' <<  s << endl;
 		cout << o_line << endl;
-	}
+	});
+}
+
+
+/** 
+ * Stream the strings of the intersection to a file descriptor, one per line, through a fixed-size 
+ * buffer: the intersection is never materialized in memory
+ *
+ * @param matches   Positions of the receiver dataset in the intersection
+ * @param items     Strings of the receiver dataset
+ * @param fd        Output file descriptor (not closed)
+ *
+ * @return          true if everything was written
+ * */
+bool write_intersection(const IntersectionBitmap &matches, const ItemStore &items, int fd)
+{
+	const size_t buffer_size = 1 << 16;
+	vector<char> buffer;
+	buffer.reserve(buffer_size);
+	bool ok = true;
+
+	auto flush = [&](){
+		size_t written = 0;
+		while(ok && written < buffer.size()){
+			ssize_t count = write(fd, buffer.data() + written, buffer.size() - written);
+			if(count < 0 && errno == EINTR)
+				continue;
+			ok = count > 0;
+			written += ok ? count : 0;
+		}
+		buffer.clear();
+	};
+
+	matches.for_each([&](size_t index){
+		string_view item = items[index];
+		if(buffer.size() + item.size() + 1 > buffer_size)
+			flush();
+		buffer.insert(buffer.end(), item.begin(), item.end());
+		buffer.push_back('\n');
+	});
+	flush();
+	return ok;
+}
+
+
+/** 
+ * Stream the strings of the intersection to a file, one per line
+ *
+ * @param matches   Positions of the receiver dataset in the intersection
+ * @param items     Strings of the receiver dataset
+ * @param path      Output path (truncated)
+ *
+ * @return          true if the file was written
+ * */
+bool write_intersection(const IntersectionBitmap &matches, const ItemStore &items, string path)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		return false;
+	bool ok = write_intersection(matches, items, fd);
+	return close(fd) == 0 && ok;
 }
 
 
 /** 
  * Write intersection result on a .txt file 
  *
- * @param intersection The strings belonging to the inresection 
+ * @param matches   Positions of the receiver dataset in the intersection
+ * @param items     Strings of the receiver dataset
  * */
-void write_result_on_file(vector<string> intersection)
+void write_result_on_file(const IntersectionBitmap &matches, const ItemStore &items)
 {
     string path = "src/output/intersection.txt";
-    ofstream result_file(path, ios::out);
     
-    if(result_file.is_open()){
-        for(string result_string : intersection)
-            result_file << result_string << "\n";
+    if(write_intersection(matches, items, path)){
 #ifdef RECV_AUDIT
         printf("\n\nOutput dataset wrote on file \n");
 #endif
-        result_file.close();
     }
     else{
 #ifdef RECV_AUDIT
@@ -1,12 +1,31 @@
+#include <functional>
 #include <list> 
 #include <vector>
 
+#include "hashing.h"
+#include "thread_pool.h"
+#include "transport.h"
 #include "utils.h"
 #include <seal/seal.h>
 
 
 using namespace seal;
 
-Ciphertext crypt_dataset(Receiver recv, size_t poly_mod_degree);
-ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sender_computation, Receiver recv);
+Ciphertext crypt_dataset(const Receiver &recv, size_t poly_mod_degree);
+size_t stream_encrypt_dataset(string dataset_path, const Receiver &recv, size_t poly_mod_degree, 
+        function<void(const Ciphertext &, const Dataset &)> consumer);
+size_t crypt_dataset_chunks(const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool,
+        function<bool(size_t, const Ciphertext &)> consumer);
+bool send_encrypted_dataset(Transport &transport, const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool);
+ComputationResult decrypt_and_intersect(size_t poly_mod_degree, Ciphertext sender_computation, 
+        const Receiver &recv);
+ComputationResult decrypt_and_intersect_chunks(size_t poly_mod_degree, const vector<Ciphertext> &responses, 
+        const Receiver &recv, ThreadPool &pool);
+ComputationResult stream_query(Transport &transport, const Receiver &recv, size_t poly_mod_degree, ThreadPool &pool);
 Receiver setup_pk_sk(EncryptionParameters params);
+Ciphertext crypt_dataset_binned(const Receiver &recv, size_t poly_mod_degree, const BinningParams &binning, 
+        vector<int64_t> &bin_items);
+ComputationResult decrypt_and_intersect_binned(size_t poly_mod_degree, const BinningParams &binning, 
+        Ciphertext sender_computation, const Receiver &recv, const vector<int64_t> &bin_items);
+bool write_intersection(const IntersectionBitmap &matches, const ItemStore &items, int fd);
+bool write_intersection(const IntersectionBitmap &matches, const ItemStore &items, string path);
@@ -12,10 +12,12 @@
 
 
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <iterator>
 #include <list>
+#include <memory>
 #include <string> 
 #include <vector>
 #include <random>
@@ -23,6 +25,8 @@
 #include <climits>
 
 #include "seal/seal.h"
+#include "hashing.h"
+#include "sender_bins.h"
 #include "utils.h"
 
 using namespace std;
@@ -52,6 +56,165 @@ vector<uint64_t> gen_rand(size_t slot_count, size_t dataset_size)
 }
 
 
+/**
+ * Encode each value of the sender's dataset into a plaintext matrix that repeats it in every slot, 
+ * ready to be subtracted from the receiver's ciphertext
+ *
+ * @param sender_dataset    Set of bitstrings of the sender (as uint64_t)
+ * @param encoder           BatchEncoder built on the scheme context
+ *
+ * @return                  One plaintext for each value of the dataset
+ * */
+vector<Plaintext> encode_sender_dataset(vector<uint64_t> sender_dataset, BatchEncoder &encoder)
+{
+	size_t slot_count = encoder.slot_count();
+	vector<Plaintext> sender_plain(sender_dataset.size());
+
+	for(size_t index = 0; index < sender_dataset.size(); index++){
+		vector<uint64_t> value_matrix(slot_count, sender_dataset[index]);
+		encoder.encode(value_matrix, sender_plain[index]);
+	}
+	return sender_plain;
+}
+
+
+/**
+ * Encode the sender's dataset placed in bins (see `hashing.h`): plaintext j holds in each slot the j-th
+ * value of the corresponding bin, and the bins with fewer values are padded. The number of plaintexts,
+ * hence the degree of the polynomial, is the largest bin load.
+ *
+ * @param sender_dataset    Set of bitstrings of the sender (as uint64_t)
+ * @param binning           Binning parameters shared with the receiver, num_bins = slot count
+ * @param encoder           BatchEncoder built on the scheme context
+ *
+ * @return                  One plaintext for each value of the largest bin
+ * */
+vector<Plaintext> encode_sender_bins(const vector<uint64_t> &sender_dataset, const BinningParams &binning, 
+        BatchEncoder &encoder)
+{
+	SenderBinTable table(binning);
+	table.build(sender_dataset);
+	return table.encode(encoder);
+}
+
+
+/**
+ * Move encoded values into shared plaintexts, so that the versions of an encoded set can share the
+ * plaintexts they have in common
+ *
+ * @param plain     Encoded values
+ *
+ * @return          The same plaintexts, one shared pointer each
+ * */
+vector<shared_ptr<const Plaintext>> share_plaintexts(vector<Plaintext> plain)
+{
+	vector<shared_ptr<const Plaintext>> shared;
+	shared.reserve(plain.size());
+	for(Plaintext &value : plain)
+		shared.push_back(make_shared<const Plaintext>(move(value)));
+	return shared;
+}
+
+
+/**
+ * Generate the random values masking every slot of the result, with values that are not zero modulo 
+ * the plain modulus: a zero mask would turn a slot into a false match (with binned items every slot
+ * holds a bin, and a chunk of the receiver dataset can have more items than the sender dataset)
+ *
+ * @param slot_count    Slot count of the matrix
+ * @param plain_modulus Value of the plain modulus
+ *
+ * @return              A vector of random uint64_t values
+ * */
+vector<uint64_t> gen_rand_mask(size_t slot_count, uint64_t plain_modulus)
+{
+	vector<uint64_t> rand_val_matrix = gen_rand(slot_count, slot_count);
+	for(uint64_t &value : rand_val_matrix)
+		value = value % plain_modulus == 0 ? 1 : value;
+	return rand_val_matrix;
+}
+
+
+/**
+ * Evaluate the PSI polynomial on the receiver's ciphertext, using the already encoded sender values
+ *
+ * @param recv_ct           Ciphertext matrix sent by the receiver
+ * @param sender_plain      Encoded sender values (see `encode_sender_dataset`)
+ * @param rand_plain        Encoded random values used to mask the result
+ * @param evaluator         Evaluator built on the scheme context
+ * @param relin_keys        Relinearization keys of the receiver
+ * @param pool              Memory pool used for the temporary allocations of SEAL
+ *
+ * @return                  The resulting ciphertext d
+ * */
+Ciphertext evaluate_psi_polynomial(const Ciphertext &recv_ct, const vector<Plaintext> &sender_plain, 
+        const Plaintext &rand_plain, Evaluator &evaluator, const RelinKeys &relin_keys, MemoryPoolHandle pool)
+{
+	Ciphertext d;
+
+	// Compute the first subtraction
+	evaluator.sub_plain(recv_ct, sender_plain[0], d);	// homomorphic computation of c_i - s_j
+
+	/* For each value of the sender dataset, compute the difference between the matrices. 
+	 * Then, multiply with the previous value to keep up with the polynomial computation 
+     * */
+	Ciphertext sub_encrypted;
+	for(size_t index = 1; index < sender_plain.size(); index++){
+        // Subtract, multiply and relinearize the result to keep the size of the ciphertext = 2
+		evaluator.sub_plain(recv_ct, sender_plain[index], sub_encrypted);
+        evaluator.multiply_inplace(d, sub_encrypted, pool);
+	    evaluator.relinearize_inplace(d, relin_keys, pool);
+    }
+
+	// Finally, multiply for the random value
+	evaluator.multiply_plain_inplace(d, rand_plain, pool);
+	evaluator.relinearize_inplace(d, relin_keys, pool);
+
+	return d;
+}
+
+
+/**
+ * Evaluate the PSI polynomial on the ciphertexts of several receivers at once. The outer loop walks
+ * the encoded sender values only once, and each of them is applied to all the ciphertexts while it is
+ * still in cache.
+ *
+ * @param recv_cts          Ciphertext matrices sent by the receivers
+ * @param sender_plain      Encoded sender values (see `encode_sender_dataset`)
+ * @param rand_plain        Encoded random values used to mask the results
+ * @param evaluator         Evaluator built on the scheme context
+ * @param relin_keys        Relinearization keys of each receiver (same order as `recv_cts`)
+ * @param pool              Memory pool used for the temporary allocations of SEAL
+ *
+ * @return                  The resulting ciphertexts, in the same order as `recv_cts`
+ * */
+vector<Ciphertext> evaluate_psi_polynomial_batch(const vector<const Ciphertext *> &recv_cts, 
+        const vector<shared_ptr<const Plaintext>> &sender_plain, const Plaintext &rand_plain, Evaluator &evaluator, 
+        const vector<const RelinKeys *> &relin_keys, MemoryPoolHandle pool)
+{
+	vector<Ciphertext> d(recv_cts.size());
+	size_t query;
+
+	for(query = 0; query < recv_cts.size(); query++)
+		evaluator.sub_plain(*recv_cts[query], *sender_plain[0], d[query]);
+
+	Ciphertext sub_encrypted;
+	for(size_t index = 1; index < sender_plain.size(); index++){
+		for(query = 0; query < recv_cts.size(); query++){
+			evaluator.sub_plain(*recv_cts[query], *sender_plain[index], sub_encrypted);
+			evaluator.multiply_inplace(d[query], sub_encrypted, pool);
+			evaluator.relinearize_inplace(d[query], *relin_keys[query], pool);
+		}
+	}
+
+	for(query = 0; query < recv_cts.size(); query++){
+		evaluator.multiply_plain_inplace(d[query], rand_plain, pool);
+		evaluator.relinearize_inplace(d[query], *relin_keys[query], pool);
+	}
+	return d;
+}
+
+
 /** 
  * The second step of thr PSI scheme: homomorphically subtract each value of the receiver's dataset from each of 
  * the sender's one, and finally multiply for a random value.
@@ -63,8 +226,6 @@ vector<uint64_t> gen_rand(size_t slot_count, size_t dataset_size)
  *
  * @return                  Homomorphic computation of the sender, the resulting ciphertext d
  * */
-//Ciphertext homomorphic_computation(Ciphertext recv_ct, size_t poly_mod_degree, vector<string> sender_dataset, 
-        //RelinKeys send_relin_keys)
 Ciphertext homomorphic_computation(Ciphertext recv_ct, size_t poly_mod_degree, vector<uint64_t> sender_dataset, 
         RelinKeys send_relin_keys)
 {
@@ -82,45 +243,19 @@ Ciphertext homomorphic_computation(Ciphertext recv_ct, size_t poly_mod_degree, v
 
 	/* Used to evalutate each single ciphertext value sent by the recevier */
 	Evaluator send_evaluator(send_context);	
-	KeyGenerator send_keygen(send_context);
-	
 
 	/* Evaluation of the polynomial expressed at the top of this file. It is the PSI scheme polynomial, 
      * that has to be computed for each element of the received ciphertext 
 	 * */
 	BatchEncoder encoder(send_context);
-	size_t index;
 	size_t slot_count = encoder.slot_count();
-	size_t row_size = slot_count/2;
+	vector<Plaintext> sender_plain = encode_sender_dataset(sender_dataset, encoder);
 
-	// Compute the first subtraction
-	vector<uint64_t> first_val_matrix(slot_count, sender_dataset[0]);
-	Plaintext first_plain;
-	encoder.encode(first_val_matrix, first_plain);
-		
-	send_evaluator.sub_plain(recv_ct, first_plain, d);	// homomorphic computation of c_i - s_j
-
-	/* For each value of the sender dataset, compute the difference between the matrices. 
-	 * Then, multiply with the previous value to keep up with the polynomial computation 
-     * */
-	for(long index = 1; index < sender_dataset.size(); index++){
-		vector<uint64_t> prod_matrix(slot_count, sender_dataset[index]);
-		Plaintext sub_plain;
-		Ciphertext sub_encrypted; 
-		encoder.encode(prod_matrix, sub_plain);
-        
-        // Subtract, multiply and relinearize the result to keep the size of the ciphertext = 2
-		send_evaluator.sub_plain(recv_ct, sub_plain, sub_encrypted);
-        send_evaluator.multiply_inplace(d, sub_encrypted);
-	    send_evaluator.relinearize_inplace(d, send_relin_keys);
-    }
-		
-	// Finally, multiply for the random value
 	Plaintext rand_plain;
-	encoder.encode(gen_rand(slot_count, sender_dataset.size()), rand_plain);	
+	encoder.encode(gen_rand_mask(slot_count, prams.plain_modulus().value()), rand_plain);	
 
-	send_evaluator.multiply_plain_inplace(d, rand_plain);
-	send_evaluator.relinearize_inplace(d, send_relin_keys);
+	d = evaluate_psi_polynomial(recv_ct, sender_plain, rand_plain, send_evaluator, send_relin_keys, 
+            MemoryManager::GetPool());
 	
 #ifdef SEND_AUDIT
     printf("Second step completed\n");
@@ -128,3 +263,47 @@ Ciphertext homomorphic_computation(Ciphertext recv_ct, size_t poly_mod_degree, v
 
 	return d;
 }
+
+
+/**
+ * Same as `homomorphic_computation`, on a receiver ciphertext whose slots are bins (see `hashing.h`):
+ * each slot is evaluated only against the sender values of its bin
+ *
+ * @param recv_ct           Ciphertext matrix sent by the receiver, one bin per slot
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param sender_dataset    Set of bitstrings of the sender
+ * @param binning           Binning parameters shared with the receiver
+ * @param send_relin_keys   Relinearization keys used to reduce chipertext size after homomorphic operations
+ *
+ * @return                  Homomorphic computation of the sender, the resulting ciphertext d
+ * */
+Ciphertext homomorphic_computation_binned(Ciphertext recv_ct, size_t poly_mod_degree, vector<uint64_t> sender_dataset, 
+        BinningParams binning, RelinKeys send_relin_keys)
+{
+	Ciphertext d;
+
+	if (sender_dataset.size() == 0 || recv_ct.size() == 0){
+#ifdef SEND_AUDIT
+		printf("Sender: an error occurred, cannot go on with the computation\n");
+#endif
+		return d;
+	}
+
+    EncryptionParameters prams = get_params(poly_mod_degree, binning_plain_bits(binning));
+	SEALContext send_context(prams);
+	Evaluator send_evaluator(send_context);
+	BatchEncoder encoder(send_context);
+
+	vector<Plaintext> sender_plain = encode_sender_bins(sender_dataset, binning, encoder);
+	Plaintext rand_plain;
+	encoder.encode(gen_rand_mask(encoder.slot_count(), prams.plain_modulus().value()), rand_plain);
+
+	d = evaluate_psi_polynomial(recv_ct, sender_plain, rand_plain, send_evaluator, send_relin_keys, 
+            MemoryManager::GetPool());
+
+#ifdef SEND_AUDIT
+    printf("Second step completed: %zu values per bin\n", sender_plain.size());
+#endif
+
+	return d;
+}
@@ -1,9 +1,27 @@
+#pragma once
+
+#include <memory>
 #include <vector>
 #include <string>
 #include <seal/seal.h>
 
+#include "hashing.h"
+
 using namespace std;
 using namespace seal;
 
+vector<uint64_t> gen_rand(size_t slot_count, size_t dataset_size);
+vector<Plaintext> encode_sender_dataset(vector<uint64_t> sender_dataset, BatchEncoder &encoder);
+vector<Plaintext> encode_sender_bins(const vector<uint64_t> &sender_dataset, const BinningParams &binning, 
+        BatchEncoder &encoder);
+vector<shared_ptr<const Plaintext>> share_plaintexts(vector<Plaintext> plain);
+vector<uint64_t> gen_rand_mask(size_t slot_count, uint64_t plain_modulus);
+Ciphertext evaluate_psi_polynomial(const Ciphertext &recv_ct, const vector<Plaintext> &sender_plain, 
+        const Plaintext &rand_plain, Evaluator &evaluator, const RelinKeys &relin_keys, MemoryPoolHandle pool);
+vector<Ciphertext> evaluate_psi_polynomial_batch(const vector<const Ciphertext *> &recv_cts, 
+        const vector<shared_ptr<const Plaintext>> &sender_plain, const Plaintext &rand_plain, Evaluator &evaluator, 
+        const vector<const RelinKeys *> &relin_keys, MemoryPoolHandle pool);
 Ciphertext homomorphic_computation(Ciphertext recv_ct, size_t poly_mod_degree, vector<uint64_t> sender_dataset, 
         RelinKeys send_relin_keys);
+Ciphertext homomorphic_computation_binned(Ciphertext recv_ct, size_t poly_mod_degree, vector<uint64_t> sender_dataset, 
+        BinningParams binning, RelinKeys send_relin_keys);
@@ -0,0 +1,204 @@
+/** Incrementally updatable bins of the sender: the polynomial of each bin is evaluated in product form,
+ *  prod_j (y - s_j), so inserting an item writes its stored value in the first free row of its bins and
+ *  erasing it moves the last value of each bin into its place. A few inserts and deletes only re-encode
+ *  the rows they touched, instead of hashing the whole dataset and encoding every row again.
+ * */
+
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "seal/seal.h"
+#include "hashing.h"
+#include "query_cache.h"
+#include "sender_bins.h"
+
+using namespace std;
+using namespace seal;
+
+static const size_t NOT_FOUND = (size_t)-1;
+
+
+/**
+ * @param binning   Binning parameters shared with the receivers, num_bins = slot count
+ * */
+SenderBinTable::SenderBinTable(const BinningParams &binning)
+    : binning(binning), padding(padding_value(binning)), loads(binning.num_bins, 0)
+{
+}
+
+
+/**
+ * Place all the items in the bins, as `simple_hash` does; the rows are considered encoded afterwards.
+ * Distinct items never share a stored value in a bin, so the items are placed without looking for
+ * them in the bins: a first pass counts the load of each bin, so that the rows are allocated once,
+ * and a second one writes each stored value in the next free row of its bin.
+ *
+ * @param items     Sender's items, without duplicates (see `dedup_values`)
+ * */
+void SenderBinTable::build(const vector<uint64_t> &items)
+{
+    fill(this->loads.begin(), this->loads.end(), 0);
+    for(uint64_t item : items)
+        for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++)
+            this->loads[bin_index(item, i, this->binning)]++;
+    size_t max_load = this->loads.empty() ? 0 : *max_element(this->loads.begin(), this->loads.end());
+
+    this->rows.assign(max_load, vector<uint64_t>(this->binning.num_bins, this->padding));
+    this->row_loads.assign(max_load, 0);
+    this->dirty.assign(max_load, 0);
+    fill(this->loads.begin(), this->loads.end(), 0);
+    for(uint64_t item : items){
+        for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+            size_t bin = bin_index(item, i, this->binning);
+            size_t row = this->loads[bin]++;
+            this->rows[row][bin] = stored_value(item, i, this->binning);
+            this->row_loads[row]++;
+        }
+    }
+    this->num_items = items.size();
+}
+
+
+/** Row of `value` in a bin, NOT_FOUND if the bin does not hold it */
+size_t SenderBinTable::find_in_bin(size_t bin, uint64_t value)
+{
+    for(size_t row = 0; row < this->loads[bin]; row++)
+        if(this->rows[row][bin] == value)
+            return row;
+    return NOT_FOUND;
+}
+
+
+/**
+ * Check whether an item is in the table: a stored value and its bin identify the item
+ * */
+bool SenderBinTable::contains(uint64_t item)
+{
+    return find_in_bin(bin_index(item, 0, this->binning), stored_value(item, 0, this->binning)) != NOT_FOUND;
+}
+
+
+/**
+ * Insert an item in its bins, adding a row if one of them is full. The stored values carry the index
+ * of the hash function, so only the first bin has to be searched for the item.
+ *
+ * @param item  Item to insert
+ *
+ * @return      false if the item was already in the table
+ * */
+bool SenderBinTable::insert(uint64_t item)
+{
+    if(contains(item))
+        return false;
+
+    for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+        size_t bin = bin_index(item, i, this->binning);
+        uint64_t value = stored_value(item, i, this->binning);
+        size_t row = this->loads[bin]++;
+        if(row == this->rows.size()){
+            this->rows.push_back(vector<uint64_t>(this->binning.num_bins, this->padding));
+            this->row_loads.push_back(0);
+            this->dirty.push_back(1);
+        }
+        this->rows[row][bin] = value;
+        this->row_loads[row]++;
+        this->dirty[row] = 1;
+    }
+    this->num_items++;
+    return true;
+}
+
+
+/**
+ * Erase an item from its bins: the last value of each bin takes its row, so the bins stay compact and
+ * the rows left without values are dropped
+ *
+ * @param item  Item to erase
+ *
+ * @return      false if the item was not in the table
+ * */
+bool SenderBinTable::erase(uint64_t item)
+{
+    if(!contains(item))
+        return false;
+
+    for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+        size_t bin = bin_index(item, i, this->binning);
+        size_t row = find_in_bin(bin, stored_value(item, i, this->binning));
+        if(row == NOT_FOUND)
+            continue;
+
+        size_t last = --this->loads[bin];
+        this->rows[row][bin] = this->rows[last][bin];
+        this->rows[last][bin] = this->padding;
+        this->row_loads[last]--;
+        this->dirty[row] = this->dirty[last] = 1;
+    }
+    while(!this->rows.empty() && this->row_loads.back() == 0){
+        this->rows.pop_back();
+        this->row_loads.pop_back();
+        this->dirty.pop_back();
+    }
+    this->num_items--;
+    return true;
+}
+
+
+/**
+ * Encode all the rows (e.g. for a context with other parameters), as `encode_sender_bins` does
+ *
+ * @param encoder   BatchEncoder built on the scheme context
+ *
+ * @return          One plaintext for each row
+ * */
+vector<Plaintext> SenderBinTable::encode(BatchEncoder &encoder) const
+{
+    vector<Plaintext> sender_plain(this->rows.size());
+    for(size_t row = 0; row < this->rows.size(); row++)
+        encoder.encode(this->rows[row], sender_plain[row]);
+    return sender_plain;
+}
+
+
+/**
+ * Bring an encoding of the table up to date, encoding only the rows changed since the last build or
+ * update. The plaintexts of the rows changed are replaced, not modified, so another version of the
+ * encoding sharing them is not affected.
+ *
+ * @param sender_plain  Plaintexts of the rows, updated in place
+ * @param encoder       BatchEncoder built on the scheme context
+ *
+ * @return              Number of rows encoded
+ * */
+size_t SenderBinTable::update_encoding(vector<shared_ptr<const Plaintext>> &sender_plain, BatchEncoder &encoder)
+{
+    size_t encoded = 0;
+    sender_plain.resize(this->rows.size());
+    for(size_t row = 0; row < this->rows.size(); row++){
+        if(!this->dirty[row] && sender_plain[row])
+            continue;
+        shared_ptr<Plaintext> plain = make_shared<Plaintext>();
+        encoder.encode(this->rows[row], *plain);
+        sender_plain[row] = plain;
+        this->dirty[row] = 0;
+        encoded++;
+    }
+    return encoded;
+}
+
+
+/**
+ * Fingerprint of the rows: two tables with the same fingerprint have the same encoding
+ * */
+uint64_t SenderBinTable::fingerprint() const
+{
+    vector<uint64_t> row_hashes;
+    for(const vector<uint64_t> &row : this->rows)
+        row_hashes.push_back(query_fingerprint(row));
+    return query_fingerprint(row_hashes);
+}
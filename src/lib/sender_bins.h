@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "seal/seal.h"
+#include "hashing.h"
+
+using namespace std;
+using namespace seal;
+
+
+/**
+ * Sender items placed in bins with simple hashing (see `hashing.h`), kept as rows of stored values:
+ * row j holds the j-th value of every bin, padded with `padding_value`, and is encoded as the j-th
+ * factor of the PSI polynomial. Items can be inserted and erased one at a time: each of them only
+ * touches one slot per hash function, and only the rows touched since the last encoding have to be
+ * encoded again.
+ * */
+class SenderBinTable
+{
+    public:
+        SenderBinTable() {}
+        SenderBinTable(const BinningParams &binning);
+
+        void build(const vector<uint64_t> &items);
+        bool insert(uint64_t item);
+        bool erase(uint64_t item);
+        bool contains(uint64_t item);
+
+        vector<Plaintext> encode(BatchEncoder &encoder) const;
+        size_t update_encoding(vector<shared_ptr<const Plaintext>> &sender_plain, BatchEncoder &encoder);
+        uint64_t fingerprint() const;
+
+        size_t size() const { return this->num_items; }
+        size_t getMaxLoad() const { return this->rows.size(); }
+
+    private:
+        size_t find_in_bin(size_t bin, uint64_t value);
+
+        BinningParams binning = {0, 0, 0};
+        uint64_t padding = 0;
+        vector<vector<uint64_t>> rows;      // rows[j][bin], the j-th stored value of the bin
+        vector<uint32_t> loads;             // values in each bin
+        vector<size_t> row_loads;           // bins having a value in each row
+        vector<char> dirty;                 // rows changed since the last encoding
+        size_t num_items = 0;
+};
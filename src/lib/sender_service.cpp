@@ -0,0 +1,901 @@
+/** Sender service: keeps the sender dataset, its encoded plaintexts and the SEAL context warm in memory
+ *  and serves receiver queries with a fixed number of worker threads.
+ *  Each worker owns a SEAL memory pool, so concurrent evaluations do not contend on the global one.
+ * */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+
+#include "seal/seal.h"
+#include "chunk_reader.h"
+#include "dedup.h"
+#include "packed_dataset.h"
+#include "plain_cache.h"
+#include "query_cache.h"
+#include "sender.h"
+#include "sender_service.h"
+
+using namespace std;
+using namespace seal;
+
+#define SERVICE_AUDIT
+
+
+/**
+ * @param poly_mod_degree   size of the polynomial modulus (bits), used to configure the parameters
+ * @param queue_capacity    Maximum number of queries waiting to be evaluated
+ * @param num_workers       Number of threads evaluating queries
+ * @param budget            Memory and CPU that the queries in flight can use
+ * @param key_cache_bytes   Memory cap of the receivers' keys cache
+ * */
+SenderService::SenderService(size_t poly_mod_degree, size_t queue_capacity, size_t num_workers, 
+        AdmissionBudget budget, size_t key_cache_bytes)
+    : params(get_params(poly_mod_degree)), key_cache(key_cache_bytes), admission(budget, num_workers), 
+      queue(queue_capacity), num_workers(num_workers)
+{
+    this->max_batch = 8;
+    this->pending.store(0);
+    this->running.store(false);
+}
+
+
+SenderService::~SenderService()
+{
+    stop();
+}
+
+
+/**
+ * Read the sender dataset and encode it, so that queries do not need to do it again
+ *
+ * @param dataset_path  Path of the sender dataset (bitstring CSV or packed binary format)
+ *
+ * @return              true if the dataset was loaded and is not empty
+ * */
+bool SenderService::load_dataset(string dataset_path)
+{
+    if(this->running.load()){
+#ifdef SERVICE_AUDIT
+        printf("Service: cannot reload the dataset while running\n");
+#endif
+        return false;
+    }
+
+    this->binned = false;
+    this->params = get_params(this->params.poly_modulus_degree());
+
+    /* The file is read one chunk of slot_count values at a time, and each chunk is encoded as soon as 
+     * it is read, instead of loading the whole file first and encoding it afterwards */
+    shared_ptr<EncodedSenderSet> encoded = make_shared<EncodedSenderSet>(this->key_cache.get_context(this->params));
+    size_t slot_count = encoded->encoder.slot_count();
+    DatasetChunkReader reader;
+    Dataset chunk;
+    this->sender_dataset.clear();
+
+    /* Duplicates would add redundant factors to the polynomial: since the file is streamed, they are 
+     * filtered against the values already seen instead of sorting the whole dataset */
+    unordered_set<uint64_t> seen;
+    vector<uint64_t> values;
+    size_t duplicates = 0;
+    if(reader.open(dataset_path, slot_count)){
+        while(reader.next_chunk(chunk)){
+            values.clear();
+            for(uint64_t value : chunk.getLongDatasetRef())
+                if(seen.insert(value).second)
+                    values.push_back(value);
+            duplicates += chunk.getLongDatasetRef().size() - values.size();
+
+            if(this->plain_cache_dir.empty()){
+                vector<shared_ptr<const Plaintext>> chunk_plain = share_plaintexts(
+                        encode_sender_dataset(values, encoded->encoder));
+                move(chunk_plain.begin(), chunk_plain.end(), back_inserter(encoded->sender_plain));
+            }
+            this->sender_dataset.insert(this->sender_dataset.end(), values.begin(), values.end());
+        }
+    }
+    if(this->sender_dataset.size() == 0){
+#ifdef SERVICE_AUDIT
+        printf("Service: sender dataset is empty\n");
+#endif
+        return false;
+    }
+    // With a cache, the whole dataset is needed to look it up, so it is encoded only if it is not found
+    if(!this->plain_cache_dir.empty())
+        encode_sender_plain(*encoded, this->params);
+    encoded->encoder.encode(gen_rand_mask(slot_count, this->params.plain_modulus().value()), encoded->rand_plain);
+
+    reset_encoded_sets(encoded);
+
+#ifdef SERVICE_AUDIT
+    printf("Service: %zu sender values loaded and encoded, %zu duplicates removed\n", this->sender_dataset.size(), 
+            duplicates);
+#endif
+    save_plain_cache();
+    return true;
+}
+
+
+/**
+ * Read a sender dataset of arbitrary strings (one per line), hash each of them into an item of
+ * `binning.item_bits` bits and encode the items placed in bins (see `load_binned_dataset`): binning is
+ * what lets the items be wide enough to keep the false matches rare (see `DEFAULT_ITEM_BITS`). The
+ * receivers must hash their strings with the same key and query with `crypt_dataset_binned`.
+ *
+ * @param dataset_path  Path of the sender dataset
+ * @param key           Key of the item hash
+ * @param binning       Binning parameters shared with the receivers, including the width of the items
+ *
+ * @return              true if the dataset was loaded and is not empty, false also if a full query
+ *                      would expect more than `MAX_EXPECTED_FALSE_MATCHES` false matches
+ * */
+bool SenderService::load_hashed_dataset(string dataset_path, const ItemHashKey &key, BinningParams binning)
+{
+    if(this->running.load() || binning.num_bins != this->params.poly_modulus_degree()){
+#ifdef SERVICE_AUDIT
+        printf("Service: cannot load the dataset while running, or with a bin count different from the slots\n");
+#endif
+        return false;
+    }
+
+    this->sender_dataset = ::load_hashed_dataset(dataset_path, key, binning.item_bits).getLongDatasetRef();
+    [[maybe_unused]] DedupStats stats = dedup_values(this->sender_dataset);  // only printed by the audit
+    if(this->sender_dataset.size() == 0){
+#ifdef SERVICE_AUDIT
+        printf("Service: sender dataset is empty\n");
+#endif
+        return false;
+    }
+    // A query holds at most one item per bin
+    double false_matches = expected_false_matches(this->sender_dataset.size(), binning.num_bins, binning.item_bits);
+    if(false_matches > MAX_EXPECTED_FALSE_MATCHES){
+#ifdef SERVICE_AUDIT
+        printf("Service: %u bit items give %.2f false matches per query, use wider items\n", binning.item_bits, 
+                false_matches);
+#endif
+        vector<uint64_t>().swap(this->sender_dataset);
+        return false;
+    }
+
+    [[maybe_unused]] size_t rows = encode_in_bins(binning);
+#ifdef SERVICE_AUDIT
+    printf("Service: %zu sender values hashed and encoded in bins (%zu duplicates removed), %zu values per bin\n",
+            this->bin_table.size(), stats.duplicates, rows);
+#endif
+    save_plain_cache();
+    return true;
+}
+
+
+/**
+ * Read the sender dataset and encode it placed in bins (see `hashing.h`): queries must then be encrypted
+ * with `crypt_dataset_binned` with the same binning parameters, and their degree is the largest bin load
+ * instead of the dataset size. The default parameters use the plain modulus required by the binning.
+ *
+ * @param dataset_path  Path of the sender dataset (bitstring CSV or packed binary format)
+ * @param binning       Binning parameters shared with the receivers
+ *
+ * @return              true if the dataset was loaded and is not empty
+ * */
+bool SenderService::load_binned_dataset(string dataset_path, BinningParams binning)
+{
+    if(this->running.load() || binning.num_bins != this->params.poly_modulus_degree()){
+#ifdef SERVICE_AUDIT
+        printf("Service: cannot load the dataset while running, or with a bin count different from the slots\n");
+#endif
+        return false;
+    }
+
+    if(is_packed_dataset(dataset_path))
+        this->sender_dataset = load_packed_dataset(dataset_path, false).getLongDatasetRef();
+    else
+        this->sender_dataset = bitstring_to_long_dataset(dataset_path);
+    [[maybe_unused]] DedupStats stats = dedup_values(this->sender_dataset);  // only printed by the audit
+    if(this->sender_dataset.size() == 0){
+#ifdef SERVICE_AUDIT
+        printf("Service: sender dataset is empty\n");
+#endif
+        return false;
+    }
+
+    [[maybe_unused]] size_t rows = encode_in_bins(binning);
+#ifdef SERVICE_AUDIT
+    printf("Service: %zu sender values encoded in bins (%zu duplicates removed), %zu values per bin\n", 
+            this->bin_table.size(), stats.duplicates, rows);
+#endif
+    save_plain_cache();
+    return true;
+}
+
+
+/**
+ * Place the sender values (distinct, not empty) in bins and encode them with the parameters required
+ * by the binning, which become the default ones; the values are then only kept in the bins
+ *
+ * @param binning   Binning parameters shared with the receivers
+ *
+ * @return          Number of rows of bins (the degree of the queries)
+ * */
+size_t SenderService::encode_in_bins(BinningParams binning)
+{
+    this->binned = true;
+    this->binning = binning;
+    this->params = get_params(binning.num_bins, binning_plain_bits(binning));
+    this->bin_table = SenderBinTable(binning);
+    this->bin_table.build(this->sender_dataset);
+    vector<uint64_t>().swap(this->sender_dataset);
+    reset_encoded_sets(nullptr);
+    return get_encoded_set(this->params)->sender_plain.size();
+}
+
+
+/**
+ * Insert and erase items of a binned dataset (see `load_binned_dataset`), also while the service is
+ * running: only the rows of the bins touched by the changes are encoded again, so the cost is 
+ * proportional to the churn. Queries already queued keep the previous version of the dataset, the
+ * following ones use the new one. Sets encoded for other parameters are encoded again on their next
+ * query. The plaintext cache is not written here, but by `save_plain_cache` or when the service stops.
+ *
+ * @param inserted  Items to insert (those already in the dataset are skipped)
+ * @param erased    Items to erase (those not in the dataset are skipped), erased before the insertions
+ *
+ * @return          false if the dataset is not binned
+ * */
+bool SenderService::update_binned_dataset(const vector<uint64_t> &inserted, const vector<uint64_t> &erased)
+{
+    if(!this->binned){
+#ifdef SERVICE_AUDIT
+        printf("Service: only binned datasets can be updated\n");
+#endif
+        return false;
+    }
+
+    // Only the dataset is locked while it is updated: the queries keep using the current sets meanwhile
+    lock_guard<mutex> dataset_lock(this->dataset_mutex);
+    size_t num_erased = 0, num_inserted = 0;
+    for(uint64_t item : erased)
+        num_erased += this->bin_table.erase(item);
+    for(uint64_t item : inserted)
+        num_inserted += this->bin_table.insert(item);
+
+    /* The set encoded with the default parameters (by `load_binned_dataset`) is kept up to date: the new
+     * version shares the plaintexts of the rows not changed, and the queries in flight keep the old one */
+    shared_ptr<EncodedSenderSet> current = find_encoded_set(this->params.parms_id());
+    shared_ptr<EncodedSenderSet> updated = make_shared<EncodedSenderSet>(current->context);
+    updated->sender_plain = current->sender_plain;
+    updated->rand_plain = current->rand_plain;
+    [[maybe_unused]] size_t encoded_rows = this->bin_table.update_encoding(updated->sender_plain, updated->encoder);
+
+    reset_encoded_sets(updated);
+    this->plain_cache_stale = true;
+
+#ifdef SERVICE_AUDIT
+    printf("Service: %zu values inserted, %zu erased, %zu of %zu rows encoded again\n", num_inserted, num_erased,
+            encoded_rows, updated->sender_plain.size());
+#endif
+    return true;
+}
+
+
+/**
+ * Return the dataset encoded for the given parameters, encoding it the first time they are seen.
+ * At most `MAX_ENCODED_SETS` sets are kept for parameters other than the default ones, the least
+ * recently used is dropped to make room for a new one, and their memory is reserved in the key cache,
+ * so that it counts against the same memory cap as the keys of the receivers using them.
+ *
+ * @param params    Encryption parameters of the query
+ *
+ * @return          The encoded dataset, null if it does not fit under the memory cap
+ * */
+shared_ptr<EncodedSenderSet> SenderService::get_encoded_set(EncryptionParameters params)
+{
+    shared_ptr<EncodedSenderSet> encoded = find_encoded_set(params.parms_id());
+    if(encoded)
+        return encoded;
+
+    /* Encoding takes long, so it is done holding only the dataset lock: the queries using the sets already
+     * encoded are not blocked meanwhile, and a set requested by several receivers is encoded once */
+    lock_guard<mutex> dataset_lock(this->dataset_mutex);
+    encoded = find_encoded_set(params.parms_id());
+    if(encoded)
+        return encoded;
+
+    encoded = make_shared<EncodedSenderSet>(this->key_cache.get_context(params));
+    if(params.parms_id() != this->params.parms_id()){
+        // One plaintext of poly_modulus_degree coefficients per value (or row of bins)
+        size_t num_plain = this->binned ? this->bin_table.getMaxLoad() : this->sender_dataset.size();
+        encoded->size_bytes = num_plain * params.poly_modulus_degree() * sizeof(uint64_t);
+        if(!this->key_cache.reserve(encoded->size_bytes)){
+#ifdef SERVICE_AUDIT
+            printf("Service: the dataset encoded for these parameters exceeds the memory cap\n");
+#endif
+            return nullptr;
+        }
+    }
+    size_t slot_count = encoded->encoder.slot_count();
+    encode_sender_plain(*encoded, params);
+    encoded->encoder.encode(gen_rand_mask(slot_count, params.plain_modulus().value()), encoded->rand_plain);
+
+    lock_guard<mutex> lock(this->encoded_mutex);
+    this->encoded_sets[params.parms_id()] = encoded;
+    if(params.parms_id() != this->params.parms_id()){
+        this->encoded_lru.push_front(params.parms_id());
+        while(this->encoded_lru.size() > MAX_ENCODED_SETS){
+            auto victim = this->encoded_sets.find(this->encoded_lru.back());
+            this->key_cache.release(victim->second->size_bytes);
+            this->encoded_sets.erase(victim);
+            this->encoded_lru.pop_back();
+        }
+    }
+    return encoded;
+}
+
+
+/**
+ * Look for the dataset encoded for the given parameters, marking it as most recently used
+ *
+ * @param parms_hash    parms_id of the parameters
+ *
+ * @return              The encoded dataset, null if it was not encoded yet
+ * */
+shared_ptr<EncodedSenderSet> SenderService::find_encoded_set(parms_id_type parms_hash)
+{
+    lock_guard<mutex> lock(this->encoded_mutex);
+    auto found = this->encoded_sets.find(parms_hash);
+    if(found == this->encoded_sets.end())
+        return nullptr;
+
+    auto position = find(this->encoded_lru.begin(), this->encoded_lru.end(), parms_hash);
+    if(position != this->encoded_lru.end())
+        this->encoded_lru.splice(this->encoded_lru.begin(), this->encoded_lru, position);
+    return found->second;
+}
+
+
+/**
+ * Replace the encoded sets, e.g. when the dataset changes, releasing the memory reserved for them
+ *
+ * @param default_set   Dataset encoded with the default parameters, null to drop every set
+ * */
+void SenderService::reset_encoded_sets(shared_ptr<EncodedSenderSet> default_set)
+{
+    lock_guard<mutex> lock(this->encoded_mutex);
+    for(auto &entry : this->encoded_sets)
+        this->key_cache.release(entry.second->size_bytes);
+    this->encoded_sets.clear();
+    this->encoded_lru.clear();
+    if(default_set)
+        this->encoded_sets[this->params.parms_id()] = default_set;
+}
+
+
+/**
+ * Fingerprint of the values encoded by the sender: the dataset values, or the rows of bins
+ * */
+uint64_t SenderService::dataset_fingerprint()
+{
+    return this->binned ? this->bin_table.fingerprint() : query_fingerprint(this->sender_dataset);
+}
+
+
+/**
+ * Encode the sender values of a set, or load them from the plaintext cache if it has them. Only the set
+ * encoded with the parameters of the service is cached: the sets of the receivers using other parameters
+ * are encoded on their first query, and would fill the cache directory with one file each.
+ *
+ * @param encoded   Set whose plaintexts are filled in
+ * @param params    Encryption parameters of the set
+ * */
+void SenderService::encode_sender_plain(EncodedSenderSet &encoded, EncryptionParameters params)
+{
+    bool cached = !this->plain_cache_dir.empty() && params.parms_id() == this->params.parms_id();
+    if(cached){
+        uint64_t dataset_hash = dataset_fingerprint();
+        string path = sender_plain_cache_path(this->plain_cache_dir, params, dataset_hash);
+        if(load_sender_plain(path, *encoded.context, params, dataset_hash, encoded.sender_plain)){
+#ifdef SERVICE_AUDIT
+            printf("Service: %zu encoded sender values loaded from %s\n", encoded.sender_plain.size(), path.c_str());
+#endif
+            this->plain_cache_path = path;
+            this->plain_cache_stale = false;
+            return;
+        }
+    }
+
+    if(this->binned)
+        encoded.sender_plain = share_plaintexts(this->bin_table.encode(encoded.encoder));
+    else
+        encoded.sender_plain = share_plaintexts(encode_sender_dataset(this->sender_dataset, encoded.encoder));
+    if(cached)
+        this->plain_cache_stale = true;
+}
+
+
+/**
+ * Save the set encoded with the parameters of the service in the plaintext cache, if it changed since it
+ * was last loaded or saved, and remove the entry it replaces. The set is written without holding the
+ * lock of the encoded sets, so the queries are not blocked meanwhile. Called after loading a dataset
+ * and when the service stops; it can also be called after `update_binned_dataset`.
+ *
+ * @return  true if the cache is up to date, false if there is no cache or it cannot be written
+ * */
+bool SenderService::save_plain_cache()
+{
+    if(this->plain_cache_dir.empty())
+        return false;
+
+    lock_guard<mutex> save_lock(this->plain_cache_mutex);
+    shared_ptr<EncodedSenderSet> current;
+    uint64_t dataset_hash;
+    string previous_path;
+    {
+        lock_guard<mutex> dataset_lock(this->dataset_mutex);
+        current = find_encoded_set(this->params.parms_id());
+        if(!this->plain_cache_stale || !current)
+            return !this->plain_cache_stale;
+        dataset_hash = dataset_fingerprint();
+        previous_path = this->plain_cache_path;
+        this->plain_cache_stale = false;
+    }
+
+    string path = sender_plain_cache_path(this->plain_cache_dir, this->params, dataset_hash);
+    if(!save_sender_plain(path, this->params, dataset_hash, current->sender_plain)){
+#ifdef SERVICE_AUDIT
+        printf("Service: cannot save the encoded sender values in %s\n", path.c_str());
+#endif
+        lock_guard<mutex> dataset_lock(this->dataset_mutex);
+        this->plain_cache_stale = true;
+        return false;
+    }
+    if(!previous_path.empty() && previous_path != path)
+        unlink(previous_path.c_str());
+
+    lock_guard<mutex> dataset_lock(this->dataset_mutex);
+    this->plain_cache_path = path;
+    return true;
+}
+
+
+/**
+ * Start the worker threads
+ *
+ * @return  true on success, false if no dataset was loaded
+ * */
+bool SenderService::start()
+{
+    if(getDatasetSize() == 0 || this->running.load())
+        return false;
+
+    {
+        unique_lock<shared_mutex> lifecycle(this->lifecycle_mutex);
+        this->running.store(true);
+    }
+    for(size_t index = 0; index < this->num_workers; index++)
+        this->workers.push_back(thread(&SenderService::worker_loop, this));
+    return true;
+}
+
+
+/**
+ * Stop the workers once they finish their current query. Queries still queued or waiting for
+ * admission are answered with an empty ciphertext.
+ * */
+void SenderService::stop()
+{
+    /* Queries are queued holding the lifecycle lock shared and checking that the service is running:
+     * once the flag is cleared under the exclusive lock, no query can be queued after the queues are
+     * drained below */
+    {
+        unique_lock<shared_mutex> lifecycle(this->lifecycle_mutex);
+        this->running.store(false);
+    }
+    {
+        lock_guard<mutex> lock(this->work_mutex);
+    }
+    this->work_available.notify_all();
+    for(thread &worker : this->workers)
+        worker.join();
+    this->workers.clear();
+    save_plain_cache();
+
+    PsiQuery *query;
+    while(this->queue.try_pop(query)){
+        this->pending.fetch_sub(1);
+        this->admission.release(query->cost, chrono::duration<double>(0));
+        query->response.set_value(Ciphertext());
+        delete query;
+    }
+
+    lock_guard<mutex> lock(this->waiting_mutex);
+    for(PsiQuery *waiting_query : this->waiting){
+        this->admission.cancel_waiting();
+        waiting_query->response.set_value(Ciphertext());
+        delete waiting_query;
+    }
+    this->waiting.clear();
+}
+
+
+/**
+ * Enqueue a query of an anonymous receiver, using the default parameters of the service
+ *
+ * @param recv_ct       Ciphertext matrix sent by the receiver
+ * @param relin_keys    Relinearization keys of the receiver
+ *
+ * @return              Admission decision and future that will hold the result of the homomorphic 
+ *                      computation (an empty ciphertext if the query could not be served)
+ * */
+QueryTicket SenderService::submit(Ciphertext recv_ct, RelinKeys relin_keys)
+{
+    PsiQuery *query = new PsiQuery();
+    query->recv_ct = move(recv_ct);
+    query->relin_keys = make_shared<RelinKeys>(move(relin_keys));
+    query->encoded = get_encoded_set(this->params);
+    return enqueue(query);
+}
+
+
+/**
+ * Check whether the keys of a receiver are still cached, so that it can skip the upload
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param params        Encryption parameters used by the receiver
+ *
+ * @return              true if the keys are cached
+ * */
+bool SenderService::has_keys(string receiver_id, EncryptionParameters params)
+{
+    return this->key_cache.contains(receiver_id, params.parms_id());
+}
+
+
+/**
+ * Deserialize and cache the relinearization keys of a receiver
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param params        Encryption parameters used by the receiver
+ * @param data          Serialized RelinKeys
+ * @param size          Size of the serialized keys (bytes)
+ *
+ * @return              true on success
+ * */
+bool SenderService::upload_keys(string receiver_id, EncryptionParameters params, const seal_byte *data, 
+        size_t size)
+{
+    return this->key_cache.insert(receiver_id, params, data, size).relin_keys != nullptr;
+}
+
+
+/**
+ * Context for the given parameters, to deserialize the receiver's ciphertexts
+ * */
+shared_ptr<SEALContext> SenderService::getContext(EncryptionParameters params)
+{
+    return this->key_cache.get_context(params);
+}
+
+
+/**
+ * Enqueue a query of a receiver whose keys were uploaded with `upload_keys`
+ *
+ * @param receiver_id   Identifier of the receiver
+ * @param params        Encryption parameters used by the receiver
+ * @param recv_ct       Ciphertext matrix sent by the receiver
+ *
+ * @return              Admission decision and future that will hold the result of the homomorphic 
+ *                      computation (an empty ciphertext if the keys are not cached or the query could 
+ *                      not be served)
+ * */
+QueryTicket SenderService::submit(string receiver_id, EncryptionParameters params, Ciphertext recv_ct)
+{
+    PsiQuery *query = new PsiQuery();
+    query->recv_ct = move(recv_ct);
+    query->relin_keys = this->key_cache.lookup(receiver_id, params.parms_id()).relin_keys;
+    if(query->relin_keys == nullptr){
+#ifdef SERVICE_AUDIT
+        printf("Service: no keys cached for receiver %s\n", receiver_id.c_str());
+#endif
+        return reject(query, chrono::milliseconds(0));
+    }
+    query->encoded = get_encoded_set(params);
+    return enqueue(query);
+}
+
+
+/**
+ * Serve a query made of several ciphertexts streamed over a transport, terminated by an end of stream
+ * marker (see `send_encrypted_dataset`). Each ciphertext is queued for evaluation as soon as it is
+ * deserialized, while the next ones are still arriving, and a sending thread streams the responses back
+ * in the same order as soon as each one is ready, followed by an end of stream marker.
+ * If a ciphertext cannot be evaluated, the end of stream marker is sent early and the rest of the
+ * query is read and dropped, so the receiver gets fewer responses than ciphertexts.
+ *
+ * @param transport     Transport connected to the receiver
+ * @param receiver_id   Identifier of the receiver, whose keys were uploaded with `upload_keys`
+ * @param params        Encryption parameters used by the receiver
+ *
+ * @return              true if every ciphertext of the query was answered
+ * */
+bool SenderService::serve_stream(Transport &transport, string receiver_id, EncryptionParameters params)
+{
+    shared_ptr<SEALContext> context = getContext(params);
+    mutex responses_mutex;
+    condition_variable responses_cv;
+    deque<future<Ciphertext>> responses;
+    bool query_over = false;
+    atomic<bool> failed(false);
+
+    thread sending([&](){
+        size_t sent = 0;
+        while(true){
+            future<Ciphertext> response;
+            {
+                unique_lock<mutex> lock(responses_mutex);
+                responses_cv.wait(lock, [&](){ return query_over || !responses.empty(); });
+                if(responses.empty())
+                    break;
+                response = move(responses.front());
+                responses.pop_front();
+            }
+            Ciphertext result = response.get();
+            if(failed.load())
+                continue;
+            if(result.size() == 0 || !send_ciphertext(transport, result)){
+                failed.store(true);
+                send_end_of_stream(transport);
+            }
+            else
+                sent++;
+        }
+        if(!failed.load())
+            send_end_of_stream(transport);
+#ifdef SERVICE_AUDIT
+        printf("Service: %zu responses streamed to receiver %s\n", sent, receiver_id.c_str());
+#endif
+    });
+
+    while(true){
+        Ciphertext recv_ct;
+        bool end_of_stream = false;
+        if(!receive_ciphertext(transport, *context, recv_ct, end_of_stream)){
+            failed.store(true);
+            break;
+        }
+        if(end_of_stream)
+            break;
+        if(failed.load())
+            continue;           // drain the query, so that the receiver is never blocked sending it
+
+        // Queries that the admission controller rejects for now are retried after the suggested delay
+        QueryTicket ticket;
+        while(true){
+            ticket = submit(receiver_id, params, recv_ct);
+            if(ticket.decision.status != AdmissionStatus::rejected || ticket.decision.retry_after.count() == 0)
+                break;
+            this_thread::sleep_for(ticket.decision.retry_after);
+        }
+        lock_guard<mutex> lock(responses_mutex);
+        responses.push_back(move(ticket.response));
+        responses_cv.notify_one();
+    }
+
+    {
+        lock_guard<mutex> lock(responses_mutex);
+        query_over = true;
+    }
+    responses_cv.notify_one();
+    sending.join();
+    return !failed.load();
+}
+
+
+/**
+ * Answer a query with an empty ciphertext
+ *
+ * @param query         Query to reject, deleted by this function
+ * @param retry_after   Hint for the submitter (0 if retrying would not help)
+ *
+ * @return              The ticket for the submitter
+ * */
+QueryTicket SenderService::reject(PsiQuery *query, chrono::milliseconds retry_after)
+{
+    QueryTicket ticket;
+    ticket.decision.status = AdmissionStatus::rejected;
+    ticket.decision.retry_after = retry_after;
+    ticket.response = query->response.get_future();
+    query->response.set_value(Ciphertext());
+    delete query;
+    return ticket;
+}
+
+
+/**
+ * Estimate the cost of a query and pass it to the workers if the admission controller allows it,
+ * otherwise park it in the waiting list or reject it
+ * */
+QueryTicket SenderService::enqueue(PsiQuery *query)
+{
+    shared_lock<shared_mutex> lifecycle(this->lifecycle_mutex);
+    if(!this->running.load() || query->recv_ct.size() == 0 || !query->encoded || 
+            query->encoded->sender_plain.size() == 0){
+        lifecycle.unlock();
+#ifdef SERVICE_AUDIT
+        printf("Service: query rejected (service stopped, empty query or dataset not encoded)\n");
+#endif
+        return reject(query, chrono::milliseconds(0));
+    }
+
+    EncryptionParameters query_params = query->encoded->context->first_context_data()->parms();
+    query->cost = estimate_query_cost(query_params, query->encoded->sender_plain.size(), 1);
+
+    AdmissionDecision decision = this->admission.try_admit(query->cost);
+    if(decision.status == AdmissionStatus::admitted && !push_query(query)){
+        this->admission.release(query->cost, chrono::duration<double>(0));
+        decision.status = AdmissionStatus::rejected;
+        decision.retry_after = this->admission.retry_hint(query->cost);
+    }
+    if(decision.status == AdmissionStatus::rejected){
+        lifecycle.unlock();
+#ifdef SERVICE_AUDIT
+        printf("Service: query rejected by admission control, retry after %ld ms\n", 
+                (long)decision.retry_after.count());
+#endif
+        return reject(query, decision.retry_after);
+    }
+
+    QueryTicket ticket;
+    ticket.decision = decision;
+    ticket.response = query->response.get_future();
+    if(decision.status == AdmissionStatus::queued){
+        {
+            lock_guard<mutex> lock(this->waiting_mutex);
+            this->waiting.push_back(query);
+        }
+        lifecycle.unlock();
+        // Resources may have been released while the query was being parked
+        drain_waiting();
+    }
+    return ticket;
+}
+
+
+/**
+ * Push a query to the workers queue and wake up a worker
+ *
+ * @return  false if the queue is full
+ * */
+bool SenderService::push_query(PsiQuery *query)
+{
+    if(!this->queue.try_push(query))
+        return false;
+    this->pending.fetch_add(1);
+    {
+        lock_guard<mutex> lock(this->work_mutex);
+    }
+    this->work_available.notify_one();
+    return true;
+}
+
+
+/**
+ * Move waiting queries to the workers queue, in arrival order, while the budget allows it
+ * */
+void SenderService::drain_waiting()
+{
+    shared_lock<shared_mutex> lifecycle(this->lifecycle_mutex);
+    if(!this->running.load())
+        return;
+    lock_guard<mutex> lock(this->waiting_mutex);
+    while(!this->waiting.empty()){
+        PsiQuery *query = this->waiting.front();
+        if(!this->admission.admit_waiting(query->cost))
+            break;
+        if(!push_query(query)){
+            // The workers queue is full: wait for the next completed query
+            this->admission.return_to_waiting(query->cost);
+            break;
+        }
+        this->waiting.pop_front();
+    }
+}
+
+
+/**
+ * Evaluate a batch of queries sharing the same encoded dataset with one pass over the sender
+ * plaintexts. If the batch fails, its queries are evaluated one by one, so that a malformed query
+ * does not take the others down with it.
+ * */
+void SenderService::evaluate_batch(vector<PsiQuery *> &batch, MemoryPoolHandle pool)
+{
+    EncodedSenderSet &encoded = *batch[0]->encoded;
+    vector<const Ciphertext *> recv_cts;
+    vector<const RelinKeys *> relin_keys;
+    for(PsiQuery *query : batch){
+        recv_cts.push_back(&query->recv_ct);
+        relin_keys.push_back(query->relin_keys.get());
+    }
+
+    try{
+        vector<Ciphertext> results = evaluate_psi_polynomial_batch(recv_cts, encoded.sender_plain, 
+                encoded.rand_plain, encoded.evaluator, relin_keys, pool);
+        for(size_t index = 0; index < batch.size(); index++)
+            batch[index]->response.set_value(move(results[index]));
+        return;
+    }
+    catch (exception& e){
+        if(batch.size() == 1){
+#ifdef SERVICE_AUDIT
+            printf("Service: an error occurred while evaluating a query: %s\n", e.what());
+#endif
+            batch[0]->response.set_value(Ciphertext());
+            return;
+        }
+    }
+
+    for(PsiQuery *query : batch){
+        vector<PsiQuery *> single(1, query);
+        evaluate_batch(single, pool);
+    }
+}
+
+
+/**
+ * Body of each worker: pop the available queries (up to `max_batch`), group those using the same
+ * encoded dataset and evaluate each group in a single pass
+ * */
+void SenderService::worker_loop()
+{
+    MemoryPoolHandle pool = MemoryPoolHandle::New();
+    PsiQuery *query;
+
+    while(this->running.load()){
+        if(!this->queue.try_pop(query)){
+            // Sleep until a query is pushed or the service stops
+            unique_lock<mutex> lock(this->work_mutex);
+            this->work_available.wait(lock, [this]{ return this->pending.load() > 0 || !this->running.load(); });
+            continue;
+        }
+        this->pending.fetch_sub(1);
+
+        map<EncodedSenderSet *, vector<PsiQuery *>> batches;
+        batches[query->encoded.get()].push_back(query);
+        size_t max_batch = this->max_batch.load();
+        for(size_t count = 1; count < max_batch && this->queue.try_pop(query); count++){
+            this->pending.fetch_sub(1);
+            batches[query->encoded.get()].push_back(query);
+        }
+
+        for(auto &entry : batches){
+            vector<PsiQuery *> &batch = entry.second;
+            chrono::high_resolution_clock::time_point before = chrono::high_resolution_clock::now();
+            evaluate_batch(batch, pool);
+            chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - before;
+
+            // Split the elapsed time among the queries, proportionally to their cost
+            double batch_units = 0;
+            for(PsiQuery *batch_query : batch)
+                batch_units += batch_query->cost.cpu_units;
+            for(PsiQuery *batch_query : batch){
+                double share = batch_units > 0 ? batch_query->cost.cpu_units / batch_units : 1.0 / batch.size();
+                this->admission.release(batch_query->cost, elapsed * share);
+                delete batch_query;
+            }
+        }
+        drain_waiting();
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "seal/seal.h"
+#include "admission.h"
+#include "bounded_queue.h"
+#include "hashing.h"
+#include "item_hash.h"
+#include "key_cache.h"
+#include "sender_bins.h"
+#include "transport.h"
+#include "utils.h"
+
+using namespace std;
+using namespace seal;
+
+
+#define MAX_ENCODED_SETS 4      // datasets kept encoded for parameters other than the default ones
+
+
+/** Sender dataset encoded under one set of encryption parameters */
+struct EncodedSenderSet
+{
+    EncodedSenderSet(shared_ptr<SEALContext> context) : context(context), evaluator(*context), encoder(*context) {}
+
+    shared_ptr<SEALContext> context;
+    Evaluator evaluator;
+    BatchEncoder encoder;
+    vector<shared_ptr<const Plaintext>> sender_plain;   // one encoded matrix per sender value (or row of bins)
+    Plaintext rand_plain;
+    size_t size_bytes = 0;                  // memory reserved in the key cache (sets of other parameters)
+};
+
+
+/** A receiver query waiting in the sender service queue */
+struct PsiQuery
+{
+    Ciphertext recv_ct;
+    shared_ptr<const RelinKeys> relin_keys;
+    shared_ptr<EncodedSenderSet> encoded;
+    QueryCost cost;
+    promise<Ciphertext> response;
+};
+
+
+/** Handle returned to the submitter of a query */
+struct QueryTicket
+{
+    AdmissionDecision decision;
+    future<Ciphertext> response;        // an empty ciphertext if the query was rejected
+};
+
+
+/**
+ * Long-running sender: the dataset is read and encoded once, together with the SEAL context,
+ * and then every receiver query only pays for the homomorphic evaluation. Queries are handed to a
+ * pool of worker threads through a bounded lock-free queue.
+ * Receivers identified by an ID upload their relinearization keys once: the keys stay in a `KeyCache`
+ * and the following queries only carry the ciphertext. Receivers using parameters different from the
+ * default ones get the dataset encoded for their parameters on their first query.
+ * Before being queued, the cost of every query is estimated: queries exceeding the admission budget
+ * wait for running ones to complete, or are rejected with a retry hint when too many are waiting.
+ * Queries from different receivers that are waiting together are batched by the workers.
+ * Queries made of several ciphertexts can be served as a stream over a `Transport`: each ciphertext is
+ * evaluated as soon as it arrives and its response is sent back as soon as it is ready.
+ * With a plaintext cache directory, the set encoded with the parameters of the service is saved there
+ * (after loading the dataset and when the service stops) and loaded back on the next start instead of
+ * being encoded again (see `plain_cache.h`).
+ * */
+class SenderService
+{
+    public:
+        SenderService(size_t poly_mod_degree, size_t queue_capacity, size_t num_workers, 
+                AdmissionBudget budget = AdmissionBudget(), size_t key_cache_bytes = 256UL << 20);
+        ~SenderService();
+
+        bool load_dataset(string dataset_path);
+        bool load_hashed_dataset(string dataset_path, const ItemHashKey &key, BinningParams binning);
+        bool load_binned_dataset(string dataset_path, BinningParams binning);
+        bool update_binned_dataset(const vector<uint64_t> &inserted, const vector<uint64_t> &erased);
+        bool start();
+        void stop();
+        QueryTicket submit(Ciphertext recv_ct, RelinKeys relin_keys);
+
+        bool has_keys(string receiver_id, EncryptionParameters params);
+        bool upload_keys(string receiver_id, EncryptionParameters params, const seal_byte *data, size_t size);
+        shared_ptr<SEALContext> getContext(EncryptionParameters params);
+        QueryTicket submit(string receiver_id, EncryptionParameters params, Ciphertext recv_ct);
+        bool serve_stream(Transport &transport, string receiver_id, EncryptionParameters params);
+
+        size_t getDatasetSize(){ return this->binned ? this->bin_table.size() : this->sender_dataset.size(); }
+        size_t getNumWorkers(){ return this->num_workers; }
+        void setMaxBatch(size_t max_batch){ this->max_batch.store(max_batch > 0 ? max_batch : 1); }
+        size_t getMaxBatch(){ return this->max_batch.load(); }
+        void setPlainCacheDir(string plain_cache_dir){ this->plain_cache_dir = plain_cache_dir; }
+        bool save_plain_cache();
+        KeyCacheStats getKeyCacheStats(){ return this->key_cache.getStats(); }
+
+    private:
+        shared_ptr<EncodedSenderSet> get_encoded_set(EncryptionParameters params);
+        shared_ptr<EncodedSenderSet> find_encoded_set(parms_id_type parms_hash);
+        void reset_encoded_sets(shared_ptr<EncodedSenderSet> default_set);
+        size_t encode_in_bins(BinningParams binning);
+        void encode_sender_plain(EncodedSenderSet &encoded, EncryptionParameters params);
+        uint64_t dataset_fingerprint();
+        QueryTicket enqueue(PsiQuery *query);
+        QueryTicket reject(PsiQuery *query, chrono::milliseconds retry_after);
+        bool push_query(PsiQuery *query);
+        void drain_waiting();
+        void evaluate_batch(vector<PsiQuery *> &batch, MemoryPoolHandle pool);
+        void worker_loop();
+
+        EncryptionParameters params;
+        KeyCache key_cache;
+        AdmissionController admission;
+
+        vector<uint64_t> sender_dataset;
+        bool binned = false;                    // dataset placed in bins, see `load_binned_dataset`
+        BinningParams binning;
+        SenderBinTable bin_table;               // items of a binned dataset (sender_dataset is then empty)
+        mutex dataset_mutex;                    // held while the dataset is encoded or updated
+        mutex encoded_mutex;
+        map<parms_id_type, shared_ptr<EncodedSenderSet>> encoded_sets;
+        list<parms_id_type> encoded_lru;        // sets of other parameters than the default, most recent first
+        string plain_cache_dir;                 // empty if the encoded sets are not cached
+        string plain_cache_path;                // cache entry of the current default set, if any
+        bool plain_cache_stale = false;         // the default set changed since it was loaded or saved
+        mutex plain_cache_mutex;                // serializes the writes of the cache
+
+        mutex waiting_mutex;
+        deque<PsiQuery *> waiting;              // queued by the admission controller
+        BoundedQueue<PsiQuery *> queue;
+        atomic<long> pending;                   // queries pushed and not yet popped by a worker
+        mutex work_mutex;
+        condition_variable work_available;      // workers wait on it while the queue is empty
+        shared_mutex lifecycle_mutex;           // held shared while queueing queries, exclusively by `stop`
+        size_t num_workers;
+        atomic<size_t> max_batch;               // queries evaluated together by a worker, read by running workers
+        vector<thread> workers;
+        atomic<bool> running;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+
+template <typename T> class Task;
+
+
+/** State shared by the promises of `Task<T>` and `Task<void>` */
+class TaskPromiseBase
+{
+    public:
+        suspend_always initial_suspend() noexcept { return {}; }
+
+        /** On completion, resume the awaiting coroutine on the same thread (symmetric transfer) */
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            template <typename Promise>
+            coroutine_handle<> await_suspend(coroutine_handle<Promise> handle) noexcept
+            {
+                coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception(){ this->error = current_exception(); }
+        void rethrow_if_failed(){ if(this->error) rethrow_exception(this->error); }
+
+        coroutine_handle<> continuation;
+
+    private:
+        exception_ptr error;
+};
+
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+    public:
+        Task<T> get_return_object();
+        void return_value(T value){ this->value.emplace(move(value)); }
+        T result(){ rethrow_if_failed(); return move(*this->value); }
+
+    private:
+        optional<T> value;
+};
+
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+    public:
+        Task<void> get_return_object();
+        void return_void() {}
+        void result(){ rethrow_if_failed(); }
+};
+
+
+/**
+ * Lazy coroutine returning a T: it starts when it is awaited (or passed to `start`) and resumes its
+ * awaiter when it completes. Exceptions are propagated to the awaiter. A task suspended by `schedule`
+ * holds no thread, so any number of them can wait for a few workers; blocking calls made by a task
+ * (e.g. the `Transport` operations, or waiting for a `SenderService` ticket) still hold its worker.
+ * */
+template <typename T>
+class Task
+{
+    public:
+        using promise_type = TaskPromise<T>;
+
+        explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+        Task(Task &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+        ~Task()
+        {
+            if(this->handle)
+                this->handle.destroy();
+        }
+
+        bool await_ready() noexcept { return false; }
+        coroutine_handle<> await_suspend(coroutine_handle<> awaiter) noexcept
+        {
+            this->handle.promise().continuation = awaiter;
+            return this->handle;
+        }
+        T await_resume(){ return this->handle.promise().result(); }
+
+    private:
+        coroutine_handle<promise_type> handle;
+};
+
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+
+/**
+ * Awaitable moving the awaiting coroutine to a worker of `pool`: `co_await schedule(pool)` before a
+ * CPU-bound step, so that the caller's thread is released. If the pool is stopped, the coroutine is not
+ * suspended and the `co_await` throws, so that the task completes with an error instead of never.
+ * */
+struct ScheduleAwaiter
+{
+    ThreadPool &pool;
+    bool refused = false;
+
+    bool await_ready() noexcept { return false; }
+    bool await_suspend(coroutine_handle<> handle)
+    {
+        this->refused = !this->pool.post([handle](){ handle.resume(); });
+        return !this->refused;
+    }
+    void await_resume()
+    {
+        if(this->refused)
+            throw runtime_error("thread pool stopped");
+    }
+};
+
+
+inline ScheduleAwaiter schedule(ThreadPool &pool)
+{
+    return ScheduleAwaiter{pool};
+}
+
+
+/** Coroutine started immediately and destroyed when it completes, used to run a `Task` to completion */
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object(){ return {}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception(){ terminate(); }
+    };
+};
+
+
+template <typename T>
+DetachedTask run_detached(Task<T> task, shared_ptr<promise<T>> result)
+{
+    try{
+        if constexpr(is_void_v<T>){
+            co_await task;
+            result->set_value();
+        }
+        else
+            result->set_value(co_await task);
+    }
+    catch(...){
+        result->set_exception(current_exception());
+    }
+}
+
+
+/**
+ * Start a task now, on the calling thread until its first suspension, and return a future holding its
+ * result. Many tasks can be started before waiting for any of them.
+ * */
+template <typename T>
+future<T> start(Task<T> task)
+{
+    auto result = make_shared<promise<T>>();
+    future<T> done = result->get_future();
+    run_detached(move(task), result);
+    return done;
+}
+
+
+/** Run a task to completion and return its result, blocking the calling thread */
+template <typename T>
+T sync_wait(Task<T> task)
+{
+    return start(move(task)).get();
+}
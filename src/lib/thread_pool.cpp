@@ -0,0 +1,133 @@
+/** Thread pool shared by the parallel stages of the receiver (decryption, decoding, encryption) */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+static const size_t NO_WORKER = (size_t)-1;
+static thread_local size_t worker_index = NO_WORKER;
+static thread_local const ThreadPool *worker_pool = nullptr;
+
+
+/**
+ * @param num_threads   Number of workers, 0 = one per core
+ * */
+ThreadPool::ThreadPool(size_t num_threads)
+{
+    if(num_threads == 0)
+        num_threads = max(1U, thread::hardware_concurrency());
+    for(size_t worker = 0; worker < num_threads; worker++)
+        this->workers.emplace_back(&ThreadPool::worker_loop, this, worker);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+
+/**
+ * Complete the queued tasks (including the ones they queue while the pool stops) and join the workers.
+ * Must not be called by a worker.
+ * */
+void ThreadPool::stop()
+{
+    {
+        lock_guard<mutex> lock(this->tasks_mutex);
+        this->stopping = true;
+    }
+    this->tasks_cv.notify_all();
+    for(thread &worker : this->workers)
+        if(worker.joinable())
+            worker.join();
+}
+
+
+/** Index of the worker running the calling thread, (size_t)-1 outside of the pool */
+size_t ThreadPool::current_worker()
+{
+    return worker_index;
+}
+
+
+void ThreadPool::worker_loop(size_t worker)
+{
+    worker_index = worker;
+    worker_pool = this;
+    while(true){
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(this->tasks_mutex);
+            this->tasks_cv.wait(lock, [this](){ return this->stopping || !this->tasks.empty(); });
+            if(this->tasks.empty())
+                return;
+            task = move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+        task();
+    }
+}
+
+
+/**
+ * Queue a task without waiting for its completion (e.g. to resume a coroutine on a worker)
+ *
+ * @return  true if the task is queued, false if the pool is stopped (the task is dropped): the tasks
+ *          queued by the workers while the pool stops are still run
+ * */
+bool ThreadPool::post(function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(this->tasks_mutex);
+        // A worker of this pool is still running, so it will take the task before exiting
+        if(this->stopping && worker_pool != this)
+            return false;
+        this->tasks.push_back(move(task));
+    }
+    this->tasks_cv.notify_one();
+    return true;
+}
+
+
+/**
+ * Run `body(index, worker)` for each index in [0, count) on the workers, and wait for all of them.
+ * Indices are handed out dynamically, so uneven iterations are balanced. The first exception thrown by
+ * an iteration is rethrown to the caller.
+ *
+ * @param count     Number of iterations
+ * @param body      Iteration, receiving the index and the worker running it
+ * */
+void ThreadPool::parallel_for(size_t count, function<void(size_t index, size_t worker)> body)
+{
+    auto next = make_shared<atomic<size_t>>(0);
+    vector<future<void>> done;
+    for(size_t task = 0; task < min(count, getNumThreads()); task++)
+        done.push_back(submit([next, count, &body](){
+            for(size_t index = next->fetch_add(1); index < count; index = next->fetch_add(1))
+                body(index, current_worker());
+        }));
+
+    exception_ptr error;
+    for(future<void> &task : done){
+        try{
+            task.get();
+        }
+        catch(...){
+            if(!error)
+                error = current_exception();
+        }
+    }
+    if(error)
+        rethrow_exception(error);
+}
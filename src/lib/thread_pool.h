@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+
+/**
+ * Fixed set of worker threads executing the submitted tasks in FIFO order. Each worker has an index in
+ * [0, getNumThreads()), so that callers can give it its own resources (e.g. a SEAL memory pool).
+ * Tasks must not wait for other tasks of the same pool. Once the pool is stopped, new tasks are refused.
+ * */
+class ThreadPool
+{
+    public:
+        ThreadPool(size_t num_threads = 0);
+        ~ThreadPool();
+
+        template <typename F>
+        future<invoke_result_t<F>> submit(F task)
+        {
+            auto packaged = make_shared<packaged_task<invoke_result_t<F>()>>(move(task));
+            future<invoke_result_t<F>> result = packaged->get_future();
+            post([packaged](){ (*packaged)(); });
+            return result;
+        }
+
+        bool post(function<void()> task);
+        void stop();
+        void parallel_for(size_t count, function<void(size_t index, size_t worker)> body);
+        size_t getNumThreads(){ return this->workers.size(); }
+        static size_t current_worker();
+
+    private:
+        void worker_loop(size_t worker);
+
+        vector<thread> workers;
+        deque<function<void()>> tasks;
+        mutex tasks_mutex;
+        condition_variable tasks_cv;
+        bool stopping = false;
+};
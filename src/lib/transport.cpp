@@ -0,0 +1,447 @@
+/** Transport layer: shared-memory ring buffers used to move serialized ciphertexts between
+ *  sender and receiver processes on the same host.
+ *  Each ring stores messages as [length (8 bytes)][payload padded to 8 bytes]; a message never wraps
+ *  around the end of the ring, so the payload can always be handed out as one contiguous region. When
+ *  there is not enough room before the end, the producer writes a wrap marker and restarts from offset 0.
+ *  A side that has to wait sleeps on the futex of the low 32 bits of the position its peer advances.
+ * */
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <thread>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "transport.h"
+
+#define TRANSPORT_AUDIT
+
+static const uint64_t WRAP_MARKER = UINT64_MAX;
+static const size_t RING_HEADER_SIZE = 4096;        // keeps each data area page-aligned
+static const unsigned SPIN_YIELDS = 64;             // yields before sleeping on the futex
+static const unsigned MAX_SLEEP_MS = 100;           // longest futex sleep, bounds a missed wake-up
+
+
+static uint64_t align8(uint64_t size)
+{
+    return (size + 7) & ~7ULL;
+}
+
+
+/** Futex word of a ring position: its low 32 bits, shared between processes */
+static uint32_t *futex_word(atomic<uint64_t> &position)
+{
+    return (uint32_t *)&position + (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ ? 1 : 0);
+}
+
+
+static void futex_sleep(atomic<uint64_t> &position, uint64_t seen, unsigned timeout_ms)
+{
+    struct timespec timeout = {(time_t)(timeout_ms / 1000), (long)(timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, futex_word(position), FUTEX_WAIT, (uint32_t)seen, &timeout, nullptr, 0);
+}
+
+
+/** Wake the threads sleeping on a ring position, if there are any */
+static void futex_wake(ShmRingHeader *ring, atomic<uint64_t> &position)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if(ring->waiters.load(memory_order_relaxed) > 0)
+        syscall(SYS_futex, futex_word(position), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+ShmTransport::~ShmTransport()
+{
+    if(this->segment != nullptr)
+        munmap(this->segment, this->segment_size);
+    if(this->fd >= 0)
+        ::close(this->fd);
+}
+
+
+/**
+ * Create a new shared segment containing both rings. The caller owns the descriptor returned by
+ * `getFd` and has to hand it to the peer process.
+ *
+ * @param ring_capacity     Size of each ring data area (bytes), must fit the largest serialized message
+ *
+ * @return                  true on success
+ * */
+bool ShmTransport::create(size_t ring_capacity)
+{
+    ring_capacity = (ring_capacity + RING_HEADER_SIZE - 1) & ~(RING_HEADER_SIZE - 1);
+    size_t segment_size = 2 * (RING_HEADER_SIZE + ring_capacity);
+
+    this->fd = memfd_create("psi_transport", MFD_CLOEXEC);
+    if(this->fd < 0 || ftruncate(this->fd, segment_size) != 0){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: cannot create shared memory segment\n");
+#endif
+        return false;
+    }
+    return map_segment(segment_size, true, ring_capacity);
+}
+
+
+/**
+ * Map a segment created by the peer with `create`. Directions are swapped, so what the creator
+ * sends is received here and vice versa.
+ *
+ * @param fd    memfd descriptor obtained from the creator process
+ *
+ * @return      true on success
+ * */
+bool ShmTransport::attach(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)(2 * RING_HEADER_SIZE)){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: invalid shared memory descriptor\n");
+#endif
+        return false;
+    }
+    this->fd = dup(fd);
+    if(this->fd < 0){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: cannot duplicate shared memory descriptor\n");
+#endif
+        return false;
+    }
+    return map_segment(st.st_size, false, 0);
+}
+
+
+bool ShmTransport::map_segment(size_t segment_size, bool init, size_t ring_capacity)
+{
+    void *segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if(segment == MAP_FAILED){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: cannot map shared memory segment\n");
+#endif
+        return false;
+    }
+    this->segment = segment;
+    this->segment_size = segment_size;
+
+    unsigned char *base = (unsigned char *)segment;
+    ShmRingHeader *first = (ShmRingHeader *)base;
+    if(init){
+        ShmRingHeader *second = (ShmRingHeader *)(base + RING_HEADER_SIZE + ring_capacity);
+        for(ShmRingHeader *hdr : {first, second}){
+            new (hdr) ShmRingHeader();
+            hdr->head.store(0);
+            hdr->tail.store(0);
+            hdr->closed.store(0);
+            hdr->waiters.store(0);
+            hdr->capacity = ring_capacity;
+        }
+    }
+    else{
+        // The capacity comes from the peer: both rings have to lie inside the mapped segment
+        ring_capacity = first->capacity;
+        if(ring_capacity == 0 || segment_size % (2 * RING_HEADER_SIZE) != 0 ||
+                ring_capacity != segment_size / 2 - RING_HEADER_SIZE ||
+                ((ShmRingHeader *)(base + RING_HEADER_SIZE + ring_capacity))->capacity != ring_capacity){
+#ifdef TRANSPORT_AUDIT
+            printf("transport: invalid ring capacity in shared memory segment\n");
+#endif
+            munmap(segment, segment_size);
+            this->segment = nullptr;
+            this->segment_size = 0;
+            return false;
+        }
+    }
+    this->capacity = ring_capacity;
+
+    ShmRingHeader *second = (ShmRingHeader *)(base + RING_HEADER_SIZE + ring_capacity);
+    this->tx = init ? first : second;
+    this->rx = init ? second : first;
+    this->tx_data = (unsigned char *)this->tx + RING_HEADER_SIZE;
+    this->rx_data = (unsigned char *)this->rx + RING_HEADER_SIZE;
+    return true;
+}
+
+
+/**
+ * Wait until `ready` holds: yield first, then sleep until the peer advances `position` of `ring`
+ *
+ * @param ring      Ring moved by the peer
+ * @param position  Position of `ring` advanced by the peer (`head` when receiving, `tail` when sending)
+ * @param sending   Also stop if this side closed its outgoing direction
+ * @param ready     Condition waited for
+ *
+ * @return          true if `ready` holds, false if the transport was closed or the timeout expired
+ * */
+bool ShmTransport::wait_ring(ShmRingHeader *ring, atomic<uint64_t> &position, bool sending, 
+        const function<bool()> &ready)
+{
+    auto closed = [&](){
+        return this->rx->closed.load(memory_order_acquire) || (sending && this->tx->closed.load(memory_order_acquire));
+    };
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(this->timeout_ms);
+
+    for(unsigned spins = 0; !ready(); spins++){
+        if(closed())
+            return false;
+        if(spins < SPIN_YIELDS){
+            this_thread::yield();
+            continue;
+        }
+
+        unsigned sleep_ms = MAX_SLEEP_MS;
+        if(this->timeout_ms != 0){
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if(now >= deadline){
+#ifdef TRANSPORT_AUDIT
+                printf("transport: no progress of the peer after %u ms\n", this->timeout_ms);
+#endif
+                return false;
+            }
+            sleep_ms = min<uint64_t>(sleep_ms, 
+                    chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1);
+        }
+
+        // The peer wakes the waiters after moving the position: check again once registered
+        uint64_t seen = position.load(memory_order_acquire);
+        ring->waiters.fetch_add(1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(!ready() && !closed())
+            futex_sleep(position, seen, sleep_ms);
+        ring->waiters.fetch_sub(1, memory_order_relaxed);
+    }
+    return true;
+}
+
+
+/**
+ * Reserve room for an outgoing message, waiting for the consumer if the ring is full.
+ *
+ * @param max_size  Upper bound of the payload size
+ *
+ * @return          Pointer where the payload has to be written, nullptr if it can never fit, the
+ *                  transport was closed or the consumer did not release room before the timeout
+ * */
+seal_byte *ShmTransport::begin_send(size_t max_size)
+{
+    uint64_t capacity = this->capacity;
+    uint64_t needed = 8 + align8(max_size);
+    if(needed > capacity){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: message of %zu bytes exceeds ring capacity\n", max_size);
+#endif
+        return nullptr;
+    }
+
+    if(this->tx->closed.load(memory_order_relaxed))
+        return nullptr;
+
+    uint64_t head = this->tx->head.load(memory_order_relaxed);
+    uint64_t offset = head % capacity;
+    uint64_t skip = (offset + needed > capacity) ? capacity - offset : 0;
+
+    // Wait until the consumer released enough space (also for the unusable tail of the ring)
+    if(!wait_ring(this->tx, this->tx->tail, true, [&](){
+                return capacity - (head - this->tx->tail.load(memory_order_acquire)) >= skip + needed; }))
+        return nullptr;
+
+    if(skip > 0){
+        memcpy(this->tx_data + offset, &WRAP_MARKER, sizeof(WRAP_MARKER));
+        offset = 0;
+    }
+    this->pending_send_pos = head + skip;
+    this->pending_send_max = max_size;
+    this->send_reserved = true;
+    return (seal_byte *)(this->tx_data + offset + 8);
+}
+
+
+/**
+ * Publish the message reserved by `begin_send`
+ *
+ * @param size  Actual payload size, not larger than the reserved one
+ *
+ * @return      true on success, false if no message is reserved or `size` exceeds the reservation
+ * */
+bool ShmTransport::end_send(size_t size)
+{
+    if(!this->send_reserved || size > this->pending_send_max){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: message of %zu bytes does not fit the reserved region\n", size);
+#endif
+        return false;
+    }
+    this->send_reserved = false;
+
+    uint64_t size64 = size;
+    uint64_t offset = this->pending_send_pos % this->capacity;
+    memcpy(this->tx_data + offset, &size64, sizeof(size64));
+    this->tx->head.store(this->pending_send_pos + 8 + align8(size), memory_order_release);
+    futex_wake(this->tx, this->tx->head);
+    return true;
+}
+
+
+/**
+ * Wait for the next incoming message. The returned region stays valid until `end_receive`.
+ *
+ * @param size  Output, size of the payload
+ *
+ * @return      Pointer to the payload inside the shared segment, nullptr if the peer closed the transport
+ *              or sent nothing before the timeout
+ * */
+const seal_byte *ShmTransport::begin_receive(size_t &size)
+{
+    uint64_t capacity = this->capacity;
+    uint64_t tail = this->rx->tail.load(memory_order_relaxed);
+
+    while(true){
+        if(!wait_ring(this->rx, this->rx->head, false, [&](){ return this->rx->head.load(memory_order_acquire) != tail; }))
+            return nullptr;
+
+        uint64_t offset = tail % capacity;
+        uint64_t length;
+        memcpy(&length, this->rx_data + offset, sizeof(length));
+        if(length == WRAP_MARKER){
+            // The producer restarted from the beginning of the ring
+            tail += capacity - offset;
+            continue;
+        }
+        if(length > capacity - offset - 8){
+#ifdef TRANSPORT_AUDIT
+            printf("transport: invalid message length %llu\n", (unsigned long long)length);
+#endif
+            return nullptr;
+        }
+
+        size = length;
+        this->pending_recv_advance = (tail - this->rx->tail.load(memory_order_relaxed)) + 8 + align8(length);
+        return (const seal_byte *)(this->rx_data + offset + 8);
+    }
+}
+
+
+/**
+ * Release the message obtained with `begin_receive`, giving its space back to the producer
+ * */
+void ShmTransport::end_receive()
+{
+    uint64_t tail = this->rx->tail.load(memory_order_relaxed);
+    this->rx->tail.store(tail + this->pending_recv_advance, memory_order_release);
+    this->pending_recv_advance = 0;
+    futex_wake(this->rx, this->rx->tail);
+}
+
+
+/**
+ * Mark the outgoing direction as closed, waking up a peer waiting in `begin_receive` or `begin_send`
+ * */
+void ShmTransport::close()
+{
+    if(this->tx != nullptr){
+        this->tx->closed.store(1, memory_order_release);
+        futex_wake(this->tx, this->tx->head);
+        futex_wake(this->tx, this->tx->tail);
+        futex_wake(this->rx, this->rx->head);
+        futex_wake(this->rx, this->rx->tail);
+    }
+}
+
+
+/**
+ * Serialize a ciphertext directly into the transport buffer (no compression, so that the peer can
+ * load it without further processing)
+ *
+ * @param transport     Transport used to reach the peer
+ * @param ct            Ciphertext to send
+ *
+ * @return              true on success
+ * */
+bool send_ciphertext(Transport &transport, const Ciphertext &ct)
+{
+    size_t max_size = ct.save_size(compr_mode_type::none);
+    seal_byte *buffer = transport.begin_send(max_size);
+    if(buffer == nullptr)
+        return false;
+
+    size_t written = ct.save(buffer, max_size, compr_mode_type::none);
+    return transport.end_send(written);
+}
+
+
+/**
+ * Receive a ciphertext, loading it from the memory lent by the transport
+ *
+ * @param transport     Transport used to reach the peer
+ * @param context       SEALContext used to validate the received ciphertext
+ * @param ct            Output ciphertext
+ *
+ * @return              true on success
+ * */
+bool receive_ciphertext(Transport &transport, const SEALContext &context, Ciphertext &ct)
+{
+    bool end_of_stream = false;
+    return receive_ciphertext(transport, context, ct, end_of_stream) && !end_of_stream;
+}
+
+
+/**
+ * Mark the end of a stream of ciphertexts (e.g. the chunks of a query) with an empty message
+ *
+ * @param transport     Transport used to reach the peer
+ *
+ * @return              true on success
+ * */
+bool send_end_of_stream(Transport &transport)
+{
+    return transport.begin_send(0) != nullptr && transport.end_send(0);
+}
+
+
+/**
+ * Receive the next ciphertext of a stream terminated by `send_end_of_stream`
+ *
+ * @param transport     Transport used to reach the peer
+ * @param context       SEALContext used to validate the received ciphertext
+ * @param ct            Output ciphertext, left untouched at the end of the stream
+ * @param end_of_stream Output, true if the message was the end of the stream
+ *
+ * @return              true on success
+ * */
+bool receive_ciphertext(Transport &transport, const SEALContext &context, Ciphertext &ct, bool &end_of_stream)
+{
+    size_t size = 0;
+    const seal_byte *buffer = transport.begin_receive(size);
+    if(buffer == nullptr)
+        return false;
+
+    end_of_stream = (size == 0);
+    if(end_of_stream){
+        transport.end_receive();
+        return true;
+    }
+
+    bool loaded = true;
+    try{
+        ct.load(context, buffer, size);
+    }
+    catch (exception& e){
+#ifdef TRANSPORT_AUDIT
+        printf("transport: received an invalid ciphertext\n");
+#endif
+        loaded = false;
+    }
+    transport.end_receive();
+    return loaded;
+}
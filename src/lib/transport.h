@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "seal/seal.h"
+
+using namespace std;
+using namespace seal;
+
+
+#define TRANSPORT_TIMEOUT_MS 60000      // default wait for the peer in `begin_send`/`begin_receive`, 0 = forever
+
+
+/**
+ * Message channel used by sender and receiver to exchange serialized SEAL objects.
+ * A message is written in place: the caller reserves a region with `begin_send`, serializes into it
+ * and publishes it with `end_send`. On the other side, `begin_receive` lends the next message until
+ * `end_receive` is called, so an implementation backed by shared memory never copies the payload.
+ * */
+class Transport
+{
+    public:
+        virtual ~Transport() {}
+
+        virtual seal_byte *begin_send(size_t max_size) = 0;
+        virtual bool end_send(size_t size) = 0;
+        virtual const seal_byte *begin_receive(size_t &size) = 0;
+        virtual void end_receive() = 0;
+        virtual void close() = 0;
+};
+
+
+/** Control block of a single-producer / single-consumer ring living in shared memory */
+struct ShmRingHeader
+{
+    atomic<uint64_t> head;          // bytes ever written by the producer
+    char head_pad[56];
+    atomic<uint64_t> tail;          // bytes ever released by the consumer
+    char tail_pad[56];
+    atomic<uint32_t> closed;
+    atomic<uint32_t> waiters;       // threads sleeping (futex) on `head` or `tail`
+    uint64_t capacity;              // size of the data area following the header
+};
+
+
+/**
+ * Transport for sender and receiver running on the same host. Two rings (one per direction) are placed
+ * in a memfd segment: the process calling `create` shares the file descriptor with its peer (e.g. through
+ * fork or SCM_RIGHTS), which calls `attach`. Ciphertexts are serialized straight into the mapped ring
+ * and loaded by the peer from the same pages, without going through a socket. A side waiting for its
+ * peer yields for a while, then sleeps on a futex until the peer moves the ring or closes the transport,
+ * and gives up after the timeout (`setTimeout`).
+ * */
+class ShmTransport : public Transport
+{
+    public:
+        ShmTransport() {}
+        ShmTransport(const ShmTransport &) = delete;
+        ShmTransport &operator=(const ShmTransport &) = delete;
+        ~ShmTransport();
+
+        bool create(size_t ring_capacity);
+        bool attach(int fd);
+        int getFd(){ return this->fd; }
+        void setTimeout(unsigned timeout_ms){ this->timeout_ms = timeout_ms; }
+
+        seal_byte *begin_send(size_t max_size) override;
+        bool end_send(size_t size) override;
+        const seal_byte *begin_receive(size_t &size) override;
+        void end_receive() override;
+        void close() override;
+
+    private:
+        bool map_segment(size_t segment_size, bool init, size_t ring_capacity);
+        bool wait_ring(ShmRingHeader *ring, atomic<uint64_t> &position, bool sending, const function<bool()> &ready);
+
+        int fd = -1;
+        void *segment = nullptr;
+        size_t segment_size = 0;
+
+        ShmRingHeader *tx = nullptr;
+        ShmRingHeader *rx = nullptr;
+        unsigned char *tx_data = nullptr;
+        unsigned char *rx_data = nullptr;
+        uint64_t capacity = 0;              // of each ring, read once: the peer can rewrite the headers
+        unsigned timeout_ms = TRANSPORT_TIMEOUT_MS;
+
+        uint64_t pending_send_pos = 0;      // ring position of the reserved message
+        size_t pending_send_max = 0;        // payload size reserved by `begin_send`
+        bool send_reserved = false;
+        uint64_t pending_recv_advance = 0;  // bytes to release on `end_receive`
+};
+
+
+bool send_ciphertext(Transport &transport, const Ciphertext &ct);
+bool receive_ciphertext(Transport &transport, const SEALContext &context, Ciphertext &ct);
+bool send_end_of_stream(Transport &transport);
+bool receive_ciphertext(Transport &transport, const SEALContext &context, Ciphertext &ct, bool &end_of_stream);
@@ -8,6 +8,8 @@
 #include <algorithm>
 
 #include "utils.h"
+#include "dedup.h"
+#include "ingest.h"
 
 #define AUDIT
 
@@ -22,26 +24,41 @@ uint64_t max_size = 64UL;   // Maximum size for the bitstring (correponds to uin
  * return                  EncryptionParameters instance
  * */
 EncryptionParameters get_params(size_t poly_mode_degree)
+{
+    return get_params(poly_mode_degree, 20);
+}
+
+
+/** 
+ * Generate EncryptionParamaters with a plain modulus of the given size: binned items (see `hashing.h`)
+ * only need the bits that are not implied by their bin
+ * 
+ * @param poly_mode_degree  Polynomial modulus degree size (in bits)
+ * @param plain_bits        Size of the plain modulus (bits)
+ *
+ * return                   EncryptionParameters instance
+ * */
+EncryptionParameters get_params(size_t poly_mode_degree, int plain_bits)
 {
     EncryptionParameters params(scheme_type::bfv);
 	params.set_poly_modulus_degree(poly_mode_degree);
 	params.set_coeff_modulus(CoeffModulus::BFVDefault(poly_mode_degree));
-	params.set_plain_modulus(PlainModulus::Batching(poly_mode_degree, 20));
+	params.set_plain_modulus(PlainModulus::Batching(poly_mode_degree, plain_bits));
 
     return params;
 }
 
 
 /**
- * Open a dataset, convert each line into a string and write in a vector  
+ * Open a dataset, convert each line into a string and write in an item store
  *
  * @param path  Dataset path
  *
- * @return      Vector of strings
+ * @return      Store of the strings
  * */
-vector<string> read_dataset_from_file(string path)
+ItemStore read_dataset_from_file(string path)
 {
-	vector<string> conv_dataset;
+	ItemStore conv_dataset;
 
 	// Try to open the file
 	ifstream dataset;
@@ -55,7 +72,7 @@ vector<string> read_dataset_from_file(string path)
 	string dataset_line;
 	
 	while(getline(dataset, dataset_line))
-		conv_dataset.push_back(dataset_line.substr(0, min(max_size, dataset_line.length())));
+		conv_dataset.push_back(dataset_line.data(), min(max_size, dataset_line.length()));
 	
 	dataset.close();
 	return conv_dataset;	
@@ -64,8 +81,8 @@ vector<string> read_dataset_from_file(string path)
 
 /** 
  * Convert a dataset of plain bitstrings into uint64_t
- * An exception can be raised (and catch) if the bitstring is not valid and it 
- * causes the impossibilty to convert it into an integer
+ * The file is memory mapped and parsed with SIMD (see `mmap_bitstring_to_long_dataset`); the conversion
+ * stops at the first line that is not a valid bitstring
  *
  * @param dataset_path  Path of the dataset 
  * 
@@ -73,20 +90,48 @@ vector<string> read_dataset_from_file(string path)
  * */
 vector<uint64_t> bitstring_to_long_dataset(string dataset_path)
 {
-	vector<string> dataset = read_dataset_from_file(dataset_path);
-    
-    vector<uint64_t> longint_dataset;
-	for(string s : dataset){
-		try{
-			longint_dataset.push_back(stoull(s, 0, 2));
-		}
-		catch (exception& e){
-			printf("An error occurred: the dataset passed is not in a valid format. Only bitstring are accepted\n");
-	        return longint_dataset;
-		}
-	}
+	return mmap_bitstring_to_long_dataset(dataset_path);
+}
+
 
-	return longint_dataset;
+/** 
+ * Load a dataset reading the file only once: each line is validated and converted into uint64_t, and 
+ * its characters are appended to the item store, so that both representations stay aligned
+ * The conversion stops at the first line that is not a valid bitstring. Large files are split at line
+ * boundaries and converted by several threads (see `parse_bitstring_file`)
+ *
+ * @param dataset_path  Path of the dataset 
+ * @param deduplicate   Remove the duplicated items (the first occurrence is kept)
+ * @param complete      Output, if not nullptr false when the file cannot be read or the conversion 
+ *                      stopped at an invalid line (the dataset then holds the lines before it)
+ * 
+ * @return              Dataset with both the integer and the string representation
+ * */
+Dataset load_dataset(string dataset_path, bool deduplicate, bool *complete)
+{
+	Dataset dataset;
+	vector<uint64_t> longint_dataset;
+	ItemStore items;
+
+	MappedFile file;
+	bool parsed = file.open(dataset_path) && 
+		parse_bitstring_file(file.getData(), file.getSize(), longint_dataset, &items);
+	if(complete != nullptr)
+		*complete = parsed;
+
+	dataset.setSigmaLength(items.size() > 0 ? items.getItem(0).length() : 0);
+	dataset.setLongDataset(move(longint_dataset));
+	dataset.setItemStore(move(items));
+	if(deduplicate){
+#ifdef AUDIT
+		DedupStats stats = dedup_dataset(dataset);
+		printf("Dataset %s: %zu items, %zu duplicates removed\n", dataset_path.c_str(), stats.input_items, 
+				stats.duplicates);
+#else
+		dedup_dataset(dataset);
+#endif
+	}
+	return dataset;
 }
 
 
@@ -1,4 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
 #include <ctime>
@@ -10,22 +16,155 @@ using namespace std;
 using namespace seal;
 
 
+/** 
+ * Strings of a dataset packed in one contiguous buffer: item i is the range [offsets[i], offsets[i+1]) 
+ * of `chars`. Avoids one heap allocation per item. Items are accessed as `string_view`s pointing into 
+ * the buffer, by index or by iterating over the store.
+ * */
+class ItemStore
+{
+    public:
+        class const_iterator
+        {
+            public:
+                using iterator_category = forward_iterator_tag;
+                using value_type = string_view;
+                using difference_type = ptrdiff_t;
+                using pointer = const string_view *;
+                using reference = string_view;
+
+                const_iterator(const ItemStore *store, size_t index) : store(store), index(index) {}
+                string_view operator*() const { return this->store->getItem(this->index); }
+                const_iterator &operator++(){ this->index++; return *this; }
+                const_iterator operator++(int){ const_iterator previous = *this; this->index++; return previous; }
+                bool operator==(const const_iterator &other) const { return this->index == other.index; }
+                bool operator!=(const const_iterator &other) const { return this->index != other.index; }
+
+            private:
+                const ItemStore *store;
+                size_t index;
+        };
+
+        ItemStore(){ this->offsets.push_back(0); }
+
+        void reserve(size_t num_items, size_t num_chars)
+        {
+            this->offsets.reserve(num_items + 1);
+            this->chars.reserve(num_chars);
+        }
+        void push_back(const char *item, size_t length)
+        {
+            this->chars.insert(this->chars.end(), item, item + length);
+            this->offsets.push_back(this->chars.size());
+        }
+        void push_back(string_view item){ push_back(item.data(), item.size()); }
+        void append(const ItemStore &other)
+        {
+            uint64_t base = this->chars.size();
+            this->chars.insert(this->chars.end(), other.chars.begin(), other.chars.end());
+            for(size_t index = 1; index < other.offsets.size(); index++)
+                this->offsets.push_back(base + other.offsets[index]);
+        }
+        void clear()
+        {
+            this->chars.clear();
+            this->offsets.assign(1, 0);
+        }
+
+        size_t size() const { return this->offsets.size() - 1; }
+        string_view getItem(size_t index) const
+        {
+            return string_view(this->chars.data() + this->offsets[index], this->offsets[index+1] - this->offsets[index]);
+        }
+        string_view operator[](size_t index) const { return getItem(index); }
+        string getString(size_t index) const { return string(getItem(index)); }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size()); }
+        size_t getCharCount() const { return this->chars.size(); }
+
+    private:
+        vector<char> chars;
+        vector<uint64_t> offsets;
+};
+
+
+/**
+ * Set of positions of the receiver dataset, one bit per item: the intersection is kept as the items
+ * that matched, and their strings are only materialized on request
+ * */
+class IntersectionBitmap
+{
+    public:
+        IntersectionBitmap(size_t num_items = 0) : words((num_items + 63) / 64, 0), num_items(num_items) {}
+
+        void set(size_t index){ this->words[index / 64] |= 1ULL << (index % 64); }
+        bool test(size_t index) const { return (this->words[index / 64] >> (index % 64)) & 1; }
+        size_t size() const { return this->num_items; }
+        size_t count() const
+        {
+            size_t total = 0;
+            for(uint64_t word : this->words)
+                total += __builtin_popcountll(word);
+            return total;
+        }
+
+        uint64_t *getWords(){ return this->words.data(); }
+        const uint64_t *getWords() const { return this->words.data(); }
+
+        /** First position in the set, `size()` if the set is empty */
+        size_t first() const
+        {
+            for(size_t w = 0; w < this->words.size(); w++)
+                if(this->words[w] != 0)
+                    return w * 64 + __builtin_ctzll(this->words[w]);
+            return this->num_items;
+        }
+
+        /** Call `f(index)` for each position in the set, in increasing order */
+        template <typename F>
+        void for_each(F f) const
+        {
+            for(size_t w = 0; w < this->words.size(); w++)
+                for(uint64_t word = this->words[w]; word != 0; word &= word - 1)
+                    f(w * 64 + __builtin_ctzll(word));
+        }
+        vector<uint64_t> getIndices() const
+        {
+            vector<uint64_t> indices;
+            indices.reserve(count());
+            for_each([&indices](size_t index){ indices.push_back(index); });
+            return indices;
+        }
+        ItemStore materialize(const ItemStore &items) const
+        {
+            ItemStore selected;
+            for_each([&](size_t index){ selected.push_back(items[index]); });
+            return selected;
+        }
+
+    private:
+        vector<uint64_t> words;
+        size_t num_items;
+};
+
+
 // Represents the dataset that receiver and sender handles
 class Dataset
 {
     public:
-        void setLongDataset(vector<uint64_t> longint_dataset){ this->longint_dataset = longint_dataset; }
-        void setStringDataset(vector<string> string_dataset){ this->string_dataset = string_dataset; }
+        void setLongDataset(vector<uint64_t> longint_dataset){ this->longint_dataset = move(longint_dataset); }
+        void setItemStore(ItemStore items){ this->items = move(items); }
         void setSigmaLength(long sigma){ this->sigma =sigma; }
 
         vector<uint64_t> getLongDataset(){ return this->longint_dataset; }
-        vector<string> getStringDataset(){ return this->string_dataset; }
-        long getSigmaLength(){ return this->sigma; }
+        const vector<uint64_t> &getLongDatasetRef() const { return this->longint_dataset; }
+        const ItemStore &getItemStore() const { return this->items; }
+        long getSigmaLength() const { return this->sigma; }
     
     private:
         vector<uint64_t> longint_dataset;   // uint64_t representation of the dataset
-        vector<string> string_dataset;
-        long sigma;                         // length (in bits) of each string
+        ItemStore items;                    // string representation of the dataset
+        long sigma = 0;                     // length (in bits) of each string
 };
 
 
@@ -39,12 +178,12 @@ class Receiver
 	    void setRecvSk(SecretKey sk){ this->recv_sk = sk; } 
 	    void setRecvPk(PublicKey pk){ this->recv_pk = pk; }
         void setRelinKeys(RelinKeys relin_keys) { this->relin_keys = relin_keys; }
-        void setDataset(Dataset recv_dataset) { this->recv_dataset = recv_dataset; }
+        void setDataset(Dataset recv_dataset) { this->recv_dataset = move(recv_dataset); }
 	
-	    SecretKey getRecvSk(){ return this->recv_sk; } 
-	    PublicKey getRecvPk(){ return this->recv_pk; }
-        RelinKeys getRelinKeys() { return this->relin_keys; }
-        Dataset getDataset() { return this->recv_dataset; }
+	    const SecretKey &getRecvSk() const { return this->recv_sk; } 
+	    const PublicKey &getRecvPk() const { return this->recv_pk; }
+        const RelinKeys &getRelinKeys() const { return this->relin_keys; }
+        const Dataset &getDataset() const { return this->recv_dataset; }
 
     private:
 	    SecretKey recv_sk;
@@ -86,24 +225,30 @@ class PsiParams
 
 /** Keeps information about the PSI computation result, such as the intersection between the two datasets and 
  *  the remaining noise after the homomorphic computation. Usefull for test cases and data gathering 
+ *  The intersection is a bitmap over the receiver dataset: the strings are materialized only on request
  *  */
 class ComputationResult{
 public:
-    ComputationResult(size_t noise_budget, vector<string> intersection)
+    ComputationResult(size_t noise_budget, IntersectionBitmap matches = IntersectionBitmap())
     {
         this->noise_budget = noise_budget;
-        this->ds_intersection = intersection;
+        this->matches = move(matches);
     }
     void setTimeVector(chrono::duration<double> time_diff) { this->time_diff = time_diff; }
-    void setIntersection(vector<string> intersection) { this->ds_intersection = intersection; }
+    void setMatches(IntersectionBitmap matches) { this->matches = move(matches); }
 	void setNoiseBudget(size_t noise_budget){ this->noise_budget = noise_budget; }
 
 	size_t getNoiseBudget(){ return this->noise_budget; }
-	vector<string> getIntersection() { return this->ds_intersection; }
+	const IntersectionBitmap &getMatches() const { return this->matches; }
+	size_t getIntersectionSize() const { return this->matches.count(); }
+	ItemStore getIntersection(const Dataset &recv_dataset) const 
+	{ 
+		return this->matches.materialize(recv_dataset.getItemStore()); 
+	}
 	chrono::duration<double> getTimeVector() { return this->time_diff; }
 private:
 	size_t noise_budget;
-	vector<string> ds_intersection;
+	IntersectionBitmap matches;             // positions of the receiver dataset in the intersection
 	
     // For time performance
 	chrono::duration<double> time_diff;
@@ -112,6 +257,8 @@ private:
 
 vector<uint64_t> bitstring_to_long_dataset(string dataset_path);
 EncryptionParameters get_params(size_t poly_mode_degree);
+EncryptionParameters get_params(size_t poly_mode_degree, int plain_bits);
 void print_line();
 void print_start_computation(PsiParams params);
-vector<string> read_dataset_from_file(string path);
+ItemStore read_dataset_from_file(string path);
+Dataset load_dataset(string dataset_path, bool deduplicate = false, bool *complete = nullptr);
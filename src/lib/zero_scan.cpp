@@ -0,0 +1,121 @@
+/** Scan of the decoded slots of the sender's response: a receiver item is in the intersection when its
+ *  slot decrypts to zero. The slots are compared with zero a vector register at a time (AVX2: 4 slots, 
+ *  SSE2: 2 slots per instruction) and the comparison masks are packed straight into the words of the 
+ *  intersection bitmap (bit i of word w = slot 64 * w + i), 64 slots per word.
+ *  The vector kernels are compiled for their instruction set whatever the target of the build, and the
+ *  widest one supported by the CPU is chosen at run time.
+ * */
+
+
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZERO_SCAN_X86
+#endif
+
+#include "zero_scan.h"
+
+static const size_t WORD_SLOTS = 64;
+
+
+/** Scan with one comparison per slot */
+static void zero_scan_scalar(const uint64_t *slots, size_t count, uint64_t *words)
+{
+    for(size_t base = 0; base < count; base += WORD_SLOTS){
+        size_t block = min(WORD_SLOTS, count - base);
+        uint64_t word = 0;
+        for(size_t i = 0; i < block; i++)
+            word |= (uint64_t)(slots[base + i] == 0) << i;
+        words[base / WORD_SLOTS] = word;
+    }
+}
+
+
+#ifdef ZERO_SCAN_X86
+/** Scan two slots per comparison: SSE2 has no 64 bit comparison, so both 32 bit halves must be zero */
+__attribute__((target("sse2")))
+static void zero_scan_sse2(const uint64_t *slots, size_t count, uint64_t *words)
+{
+    for(size_t base = 0; base < count; base += WORD_SLOTS){
+        size_t block = min(WORD_SLOTS, count - base);
+        uint64_t word = 0;
+        size_t i = 0;
+        for(; i + 2 <= block; i += 2){
+            __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(slots + base + i)), _mm_setzero_si128());
+            equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+            word |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(equal)) << i;
+        }
+        for(; i < block; i++)
+            word |= (uint64_t)(slots[base + i] == 0) << i;
+        words[base / WORD_SLOTS] = word;
+    }
+}
+
+
+/** Scan four slots per comparison */
+__attribute__((target("avx2")))
+static void zero_scan_avx2(const uint64_t *slots, size_t count, uint64_t *words)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    for(size_t base = 0; base < count; base += WORD_SLOTS){
+        size_t block = min(WORD_SLOTS, count - base);
+        uint64_t word = 0;
+        size_t i = 0;
+        for(; i + 4 <= block; i += 4){
+            __m256i value = _mm256_loadu_si256((const __m256i *)(slots + base + i));
+            word |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(value, zero))) << i;
+        }
+        for(; i < block; i++)
+            word |= (uint64_t)(slots[base + i] == 0) << i;
+        words[base / WORD_SLOTS] = word;
+    }
+}
+#endif
+
+
+/**
+ * Whether a kernel can run on this CPU
+ * */
+bool zero_scan_supported(ZeroScanKernel kernel)
+{
+    switch(kernel){
+        case ZeroScanKernel::automatic:
+        case ZeroScanKernel::scalar:
+            return true;
+#ifdef ZERO_SCAN_X86
+        case ZeroScanKernel::sse2:
+            return __builtin_cpu_supports("sse2");
+        case ZeroScanKernel::avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Find the zero slots
+ *
+ * @param slots     Decoded slots
+ * @param count     Number of slots scanned
+ * @param words     Output, ceil(count / 64) bitmap words, bit i set if slots[i] == 0
+ * @param kernel    Implementation used, it must be supported by the CPU (see `zero_scan_supported`)
+ * */
+void zero_scan(const uint64_t *slots, size_t count, uint64_t *words, ZeroScanKernel kernel)
+{
+#ifdef ZERO_SCAN_X86
+    static const ZeroScanKernel best = zero_scan_supported(ZeroScanKernel::avx2) ? ZeroScanKernel::avx2 :
+            (zero_scan_supported(ZeroScanKernel::sse2) ? ZeroScanKernel::sse2 : ZeroScanKernel::scalar);
+    if(kernel == ZeroScanKernel::automatic)
+        kernel = best;
+    if(kernel == ZeroScanKernel::avx2)
+        return zero_scan_avx2(slots, count, words);
+    if(kernel == ZeroScanKernel::sse2)
+        return zero_scan_sse2(slots, count, words);
+#endif
+    zero_scan_scalar(slots, count, words);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+
+/** Implementations of `zero_scan`: `automatic` picks the widest one supported by the CPU */
+enum class ZeroScanKernel { automatic, scalar, sse2, avx2 };
+
+
+bool zero_scan_supported(ZeroScanKernel kernel);
+void zero_scan(const uint64_t *slots, size_t count, uint64_t *words, ZeroScanKernel kernel = ZeroScanKernel::automatic);
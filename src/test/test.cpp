@@ -5,6 +5,7 @@
 #include <iostream>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
 #include <stdlib.h>
@@ -12,6 +13,8 @@
 
 #include "../lib/sender.h"
 #include "../lib/receiver.h"
+#include "../lib/dedup.h"
+#include "../lib/key_store.h"
 
 
 /** Generate random codes and write them into the output dataset file 
@@ -80,11 +83,11 @@ vector<string> create_send_recv_dataset(int n_entries, int string_length, int n_
  * Compare the result obtained with the expected vector, to check if the the test passed 
  *
  * @param   expected Vector of expected strings 
- * @param   actual Vector of the actual result 
+ * @param   actual Items of the actual result 
  *
  * @return  0 in case of success, -1 in case of failure 
  * */
-int check_result(vector<string> expected, vector<string> actual)
+int check_result(vector<string> expected, const ItemStore &actual)
 {
 	if (actual.size() == 0)		// the intersection is null
 		return -1;
@@ -92,7 +95,7 @@ int check_result(vector<string> expected, vector<string> actual)
 	int result = -1;
 	bool found = false;
 	for(string s_e : expected){
-	    for (string s_a : actual){
+	    for (string_view s_a : actual){
 			if(s_e.substr(0, s_e.length()-1).compare(s_a) == 0){
 				found = true;
 				break;
@@ -160,12 +163,14 @@ vector<PsiParams> getTestCases()
 int main (int argc, char *argv[])
 {
 	if(argc < 3){
-        printf("Usage:\n1) prog\n2) path for recevier dataset\n3) Path for sender dataset\n");
+        printf("Usage:\n1) prog\n2) path for recevier dataset\n3) Path for sender dataset\n"
+                "4) directory of the receiver keys (optional, see generate_keys)\n");
         return 0;
     }
 
     string recv_path = argv[1];
     string send_path = argv[2];
+    string key_dir = (argc > 3) ? argv[3] : "";
 
     cout << "Paths:" << recv_path << "," << send_path << endl;
 
@@ -184,16 +189,14 @@ int main (int argc, char *argv[])
 		// Setup the parameters for the homomorphic scheme
     	EncryptionParameters params = get_params(param.getPolyModDegree());
 		
-        // Setup receiver `Dataset` and `Receiver` class 
-        Dataset recv_dataset;
-        recv_dataset.setLongDataset(bitstring_to_long_dataset(recv_path));
-        recv_dataset.setStringDataset(read_dataset_from_file(recv_path));
-        recv_dataset.setSigmaLength(recv_dataset.getStringDataset()[0].length());
-        Receiver recv = setup_pk_sk(params);
+        // Setup receiver `Dataset` (reading the file once, without duplicates) and `Receiver` class 
+        Dataset recv_dataset = load_dataset(recv_path, true);
+        Receiver recv = key_dir.empty() ? setup_pk_sk(params) : load_or_setup_pk_sk(params, key_dir);
         recv.setDataset(recv_dataset);
 
-        // Convert sender dataset into uint64_t
+        // Convert sender dataset into uint64_t and remove its duplicates
         vector<uint64_t> sender_dataset = bitstring_to_long_dataset(send_path);
+        dedup_values(sender_dataset);
 
 		// Set up the high res clock
 		chrono::high_resolution_clock::time_point before, after;
@@ -212,7 +215,7 @@ int main (int argc, char *argv[])
 		test_class_vector.push_back(result);
 		
         // Test assetion 
-		if(check_result(intersection, result.getIntersection()) == 0)
+		if(check_result(intersection, result.getIntersection(recv.getDataset())) == 0)
 			cout << "\033[1;32mTest success \033[0m\n";
 		else
 			cout << "\033[1;31mTest failed \033[0m\n";
@@ -0,0 +1,1896 @@
+/** Unit tests of the library components: the exit status is not zero if any of them fails */
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../lib/chunk_reader.h"
+#include "../lib/dedup.h"
+#include "../lib/file_store.h"
+#include "../lib/hashing.h"
+#include "../lib/ingest.h"
+#include "../lib/item_hash.h"
+#include "../lib/key_store.h"
+#include "../lib/packed_dataset.h"
+#include "../lib/plain_cache.h"
+#include "../lib/query_cache.h"
+#include "../lib/receiver.h"
+#include "../lib/sender.h"
+#include "../lib/sender_bins.h"
+#include "../lib/sender_service.h"
+#include "../lib/task.h"
+#include "../lib/thread_pool.h"
+#include "../lib/transport.h"
+#include "../lib/utils.h"
+#include "../lib/zero_scan.h"
+
+
+#define TEST_DIR "unit_test_files"      // scratch directory of the tests writing files, removed at the end
+
+
+/** Path of a scratch file of the tests */
+string test_path(string name)
+{
+    return string(TEST_DIR) + "/" + name;
+}
+
+
+/** Write a text file of the tests */
+void write_text_file(string path, string content)
+{
+    ofstream file(path, ios::out | ios::trunc);
+    file << content;
+}
+
+
+/** Content of a binary file of the tests */
+string read_binary_file(string path)
+{
+    ifstream file(path, ios::binary);
+    return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+}
+
+
+/** Bitstring of `item_bits` characters of a value, most significant bit first */
+string to_bitstring(uint64_t value, unsigned item_bits)
+{
+    string bitstring(item_bits, '0');
+    for(unsigned bit = 0; bit < item_bits; bit++)
+        bitstring[bit] = '0' + ((value >> (item_bits - 1 - bit)) & 1);
+    return bitstring;
+}
+
+
+/** Items of `item_bits` bits drawn at random, without duplicates */
+vector<uint64_t> gen_rand_items(size_t count, unsigned item_bits, uint64_t seed)
+{
+    mt19937_64 generator(seed);
+    vector<uint64_t> items;
+    while(items.size() < count){
+        while(items.size() < count)
+            items.push_back(generator() & ((1ULL << item_bits) - 1));
+        sort(items.begin(), items.end());
+        items.erase(unique(items.begin(), items.end()), items.end());
+    }
+    shuffle(items.begin(), items.end(), generator);
+    return items;
+}
+
+
+/** Decode the plaintexts of the rows of a `SenderBinTable`, row by row */
+vector<vector<uint64_t>> decode_rows(const vector<shared_ptr<const Plaintext>> &sender_plain, BatchEncoder &encoder)
+{
+    vector<vector<uint64_t>> rows(sender_plain.size());
+    for(size_t row = 0; row < sender_plain.size(); row++)
+        encoder.decode(*sender_plain[row], rows[row]);
+    return rows;
+}
+
+
+/** Values of each bin in decoded rows, sorted: the roots of the bin polynomials, whatever their order */
+vector<vector<uint64_t>> bin_roots(const vector<vector<uint64_t>> &rows, size_t num_bins)
+{
+    vector<vector<uint64_t>> roots(num_bins);
+    for(const vector<uint64_t> &row : rows)
+        for(size_t bin = 0; bin < num_bins; bin++)
+            roots[bin].push_back(row[bin]);
+    for(vector<uint64_t> &bin : roots)
+        sort(bin.begin(), bin.end());
+    return roots;
+}
+
+
+/**
+ * `SenderBinTable`: inserting and erasing items, then encoding only the rows changed, must give the
+ * same bin polynomials as building the table from scratch with the resulting items
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_sender_bins()
+{
+    const size_t poly_mod_degree = 8192;
+    BinningParams binning = make_binning_params(poly_mod_degree, 40, 42);
+    SEALContext context(get_params(poly_mod_degree, binning_plain_bits(binning)));
+    BatchEncoder encoder(context);
+
+    vector<uint64_t> items = gen_rand_items(30000, binning.item_bits, 1);
+    vector<uint64_t> initial(items.begin(), items.begin() + 20000);
+    SenderBinTable table(binning);
+    table.build(initial);
+    vector<shared_ptr<const Plaintext>> sender_plain = share_plaintexts(table.encode(encoder));
+    vector<shared_ptr<const Plaintext>> previous = sender_plain;
+
+    /* The first item is in the first row of its bins: erasing it moves the last value of the bin into
+     * its row */
+    size_t bin = bin_index(items[0], 0, binning);
+    uint64_t value = stored_value(items[0], 0, binning);
+    if(!table.erase(items[0]) || table.contains(items[0]) || table.erase(items[0]))
+        return -1;
+    table.update_encoding(sender_plain, encoder);
+    vector<vector<uint64_t>> rows = decode_rows(sender_plain, encoder);
+    if(rows[0][bin] == value || rows[0][bin] == padding_value(binning))
+        return -1;
+
+    // Erasing a missing item and inserting a present one change nothing
+    if(table.erase(items[25000]) || table.insert(items[2]) || table.size() != initial.size() - 1)
+        return -1;
+
+    // Churn, then erase most of the items so that the last rows are dropped
+    for(size_t index = 20000; index < 25000; index++)
+        table.insert(items[index]);
+    for(size_t index = 1; index < 10000; index++)
+        table.erase(items[index]);
+    size_t encoded_rows = table.update_encoding(sender_plain, encoder);
+    size_t full_load = previous.size();
+    for(size_t index = 10000; index < 24000; index++)
+        table.erase(items[index]);
+    table.update_encoding(sender_plain, encoder);
+
+    vector<uint64_t> remaining(items.begin() + 24000, items.begin() + 25000);
+    SenderBinTable rebuilt(binning);
+    rebuilt.build(remaining);
+    if(table.size() != remaining.size() || table.getMaxLoad() != rebuilt.getMaxLoad() ||
+            sender_plain.size() != rebuilt.getMaxLoad() || sender_plain.size() >= full_load)
+        return -1;
+    if(encoded_rows > full_load || bin_roots(decode_rows(sender_plain, encoder), binning.num_bins) !=
+            bin_roots(decode_rows(share_plaintexts(rebuilt.encode(encoder)), encoder), binning.num_bins))
+        return -1;
+    for(uint64_t item : remaining)
+        if(!table.contains(item))
+            return -1;
+
+    // The previous version of the encoding is not modified by the updates
+    SenderBinTable original(binning);
+    original.build(initial);
+    if(decode_rows(previous, encoder) != decode_rows(share_plaintexts(original.encode(encoder)), encoder))
+        return -1;
+    return 0;
+}
+
+
+/** Task moving to a worker of `pool`, returning the index of that worker plus `value` times the pool size */
+Task<size_t> worker_task(ThreadPool &pool, size_t value)
+{
+    co_await schedule(pool);
+    co_return ThreadPool::current_worker() + value * pool.getNumThreads();
+}
+
+
+/** Task awaiting two other tasks, then failing if asked to */
+Task<size_t> nested_task(ThreadPool &pool, size_t value, bool fail)
+{
+    size_t first = co_await worker_task(pool, value);
+    size_t second = co_await worker_task(pool, value);
+    if(fail)
+        throw runtime_error("task failed");
+    co_return (first / pool.getNumThreads()) + (second / pool.getNumThreads());
+}
+
+
+Task<void> void_task(ThreadPool &pool, size_t &output)
+{
+    output = co_await nested_task(pool, 21, false);
+}
+
+
+/**
+ * `Task`, `start` and `sync_wait`: tasks run on the workers of the pool, awaiting tasks get their
+ * results and exceptions, many tasks can be in flight on fewer workers, and a stopped pool fails the
+ * tasks scheduled on it
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_tasks()
+{
+    ThreadPool pool(2);
+
+    // The task body runs on a worker, not on the thread calling `sync_wait`
+    size_t result = sync_wait(worker_task(pool, 3));
+    if(result / 2 != 3 || result % 2 >= pool.getNumThreads())
+        return -1;
+    if(sync_wait(nested_task(pool, 5, false)) != 10)
+        return -1;
+
+    size_t output = 0;
+    sync_wait(void_task(pool, output));
+    if(output != 42)
+        return -1;
+
+    // The exception thrown by a task reaches the caller
+    try{
+        sync_wait(nested_task(pool, 1, true));
+        return -1;
+    }
+    catch(runtime_error &e){}
+
+    // Tasks started together complete independently, in any order
+    vector<future<size_t>> done;
+    for(size_t index = 0; index < 200; index++)
+        done.push_back(start(nested_task(pool, index, index % 50 == 7)));
+    for(size_t index = 0; index < done.size(); index++){
+        try{
+            if(done[index].get() != 2 * index || index % 50 == 7)
+                return -1;
+        }
+        catch(runtime_error &e){
+            if(index % 50 != 7)
+                return -1;
+        }
+    }
+
+    // Tasks in flight when the pool stops complete; tasks scheduled afterwards fail instead of hanging
+    ThreadPool stopped(1);
+    vector<future<size_t>> in_flight;
+    for(size_t index = 0; index < 20; index++)
+        in_flight.push_back(start(nested_task(stopped, index, false)));
+    stopped.stop();
+    for(size_t index = 0; index < in_flight.size(); index++)
+        if(in_flight[index].get() != 2 * index)
+            return -1;
+    future<size_t> late = start(worker_task(stopped, 1));
+    if(late.wait_for(chrono::seconds(0)) != future_status::ready)
+        return -1;
+    try{
+        late.get();
+        return -1;
+    }
+    catch(runtime_error &e){}
+    return 0;
+}
+
+
+/** Values of a dataset in the slot order chosen by `plan_delta_layout`, empty if `order` is not a permutation */
+vector<uint64_t> apply_layout(const vector<size_t> &order, const vector<uint64_t> &values)
+{
+    vector<char> used(values.size(), 0);
+    vector<uint64_t> layout;
+    for(size_t index : order){
+        if(index >= values.size() || used[index])
+            return vector<uint64_t>();
+        used[index] = 1;
+        layout.push_back(values[index]);
+    }
+    return layout.size() == values.size() ? layout : vector<uint64_t>();
+}
+
+
+/**
+ * `plan_delta_layout`: every value gets one slot, the values still present keep theirs, and the
+ * holes are filled without leaving gaps
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_delta_layout()
+{
+    // No previous layout: the values keep their order
+    vector<uint64_t> values = {9, 4, 7, 1};
+    if(apply_layout(plan_delta_layout({}, values), values) != values)
+        return -1;
+    if(apply_layout(plan_delta_layout(values, values), values) != values)
+        return -1;
+
+    // Duplicates get one slot each, the extra copy goes after the last slot
+    values = {7, 5, 5, 5};
+    if(apply_layout(plan_delta_layout({5, 5, 7}, values), values) != vector<uint64_t>({5, 5, 7, 5}))
+        return -1;
+
+    // More removals than additions: the new value fills the first hole, the last value the other one
+    values = {6, 2, 9};
+    if(apply_layout(plan_delta_layout({1, 2, 3, 4, 5, 6}, values), values) != vector<uint64_t>({9, 2, 6}))
+        return -1;
+    values = {};
+    if(!plan_delta_layout({1, 2, 3}, values).empty())
+        return -1;
+
+    // Random churn: the layout is a permutation of the new values
+    mt19937_64 generator(7);
+    for(int round = 0; round < 200; round++){
+        vector<uint64_t> previous;
+        for(size_t index = generator() % 60; index > 0; index--)
+            previous.push_back(generator() % 40);
+        values = previous;
+        shuffle(values.begin(), values.end(), generator);
+        values.resize(values.size() - generator() % (values.size() / 3 + 1));
+        for(size_t index = generator() % 10; index > 0; index--)
+            values.push_back(generator() % 50);
+
+        vector<uint64_t> layout = apply_layout(plan_delta_layout(previous, values), values);
+        if(layout.size() != values.size())
+            return -1;
+        vector<uint64_t> sorted_layout = layout, sorted_values = values;
+        sort(sorted_layout.begin(), sorted_layout.end());
+        sort(sorted_values.begin(), sorted_values.end());
+        if(sorted_layout != sorted_values)
+            return -1;
+    }
+    return 0;
+}
+
+
+/** Decrypt the chunks of a query, in slot order */
+vector<uint64_t> decrypt_query(const vector<Ciphertext> &query, const SEALContext &context, const Receiver &recv)
+{
+    Decryptor decryptor(context, recv.getRecvSk());
+    BatchEncoder encoder(context);
+    vector<uint64_t> slots;
+    for(const Ciphertext &ct : query){
+        Plaintext plain;
+        vector<uint64_t> chunk;
+        decryptor.decrypt(ct, plain);
+        encoder.decode(plain, chunk);
+        slots.insert(slots.end(), chunk.begin(), chunk.end());
+    }
+    return slots;
+}
+
+
+/**
+ * `crypt_dataset_delta`: after a small change of the dataset only the changed chunks are encrypted
+ * again, and the query (reused chunks included) decrypts to the reordered dataset
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_query_delta()
+{
+    const size_t poly_mod_degree = 8192;
+    const string cache_path = test_path("query.bin");
+    EncryptionParameters params = get_params(poly_mod_degree);
+    SEALContext context(params);
+    size_t slot_count = BatchEncoder(context).slot_count();
+    ThreadPool pool(2);
+    Receiver recv = setup_pk_sk(params);
+    remove(cache_path.c_str());
+
+    const unsigned item_bits = 19;     // the unbinned query encodes the items as they are: below the plain modulus
+    vector<uint64_t> items = gen_rand_items(4 * slot_count, item_bits, 3);
+    vector<vector<uint64_t>> versions(2);
+    versions[0].assign(items.begin(), items.begin() + 3 * slot_count + 100);
+    // Second version: values removed from the first chunk, fewer values added
+    versions[1] = versions[0];
+    versions[1].erase(versions[1].begin() + 10, versions[1].begin() + 60);
+    versions[1].insert(versions[1].end(), items.begin() + 3 * slot_count + 100, items.begin() + 3 * slot_count + 130);
+
+    int result = 0;
+    for(size_t version = 0; version < versions.size() && result == 0; version++){
+        Dataset dataset;
+        dataset.setSigmaLength(item_bits);
+        dataset.setLongDataset(versions[version]);
+        recv.setDataset(move(dataset));
+
+        QueryDeltaStats stats;
+        vector<Ciphertext> query = crypt_dataset_delta(recv, poly_mod_degree, cache_path, pool, &stats);
+        const vector<uint64_t> &layout = recv.getDataset().getLongDatasetRef();
+        vector<uint64_t> sorted_layout = layout, sorted_values = versions[version];
+        sort(sorted_layout.begin(), sorted_layout.end());
+        sort(sorted_values.begin(), sorted_values.end());
+
+        vector<uint64_t> slots = decrypt_query(query, context, recv);
+        vector<uint64_t> expected = layout;
+        expected.resize(query.size() * slot_count, 0);
+        if(sorted_layout != sorted_values || slots != expected || stats.chunks != query.size() ||
+                stats.reused + stats.reencrypted != stats.chunks)
+            result = -1;
+        // The first chunk and the last one change, the two in the middle are reused
+        if(version == 0 && stats.reused != 0)
+            result = -1;
+        if(version == 1 && stats.reused != 2)
+            result = -1;
+    }
+    remove(cache_path.c_str());
+    return result;
+}
+
+
+/**
+ * `AtomicFileWriter`: writers saving the same path at the same time each write their own temporary
+ * file, so the file is always one of the complete versions, and no temporary file is left behind
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_atomic_writers()
+{
+    const string path = test_path("atomic.bin");
+    const size_t num_writers = 4, num_pieces = 64, piece_size = 4096;
+    vector<vector<unsigned char>> contents(num_writers);
+    for(size_t writer = 0; writer < num_writers; writer++)
+        contents[writer].assign(num_pieces * piece_size, (unsigned char)('a' + writer));
+
+    for(int round = 0; round < 20; round++){
+        vector<thread> writers;
+        vector<char> committed(num_writers, 0);
+        for(size_t writer = 0; writer < num_writers; writer++){
+            writers.emplace_back([&, writer](){
+                AtomicFileWriter file;
+                bool ok = file.open(path);
+                for(size_t piece = 0; ok && piece < num_pieces; piece++){
+                    ok = file.write(contents[writer].data() + piece * piece_size, piece_size);
+                    this_thread::yield();
+                }
+                committed[writer] = ok && file.commit();
+            });
+        }
+        for(thread &writer : writers)
+            writer.join();
+        if(count(committed.begin(), committed.end(), 1) != (long)num_writers)
+            return -1;
+
+        MappedFile file;
+        if(!file.open(path) || file.getSize() != contents[0].size())
+            return -1;
+        const unsigned char *data = (const unsigned char *)file.getData();
+        bool complete = false;
+        for(const vector<unsigned char> &content : contents)
+            complete = complete || equal(content.begin(), content.end(), data);
+        if(!complete)
+            return -1;
+    }
+
+    size_t files = 0;
+    for(const filesystem::directory_entry &entry : filesystem::directory_iterator(TEST_DIR))
+        files += entry.path().filename().string().rfind("atomic.bin", 0) == 0;
+    remove(path.c_str());
+    return files == 1 ? 0 : -1;
+}
+
+
+/**
+ * Packed datasets: a CSV dataset converted and loaded back gives the same values and bitstrings, and
+ * datasets that cannot be represented are rejected instead of being truncated
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_packed_dataset()
+{
+    const unsigned item_bits = 24;
+    vector<uint64_t> items = gen_rand_items(1000, item_bits, 5);
+    items.push_back(items[3]);
+    string csv;
+    for(uint64_t item : items)
+        csv += to_bitstring(item, item_bits) + "\n";
+    write_text_file(test_path("packed.csv"), csv);
+
+    if(!convert_csv_to_packed(test_path("packed.csv"), test_path("packed.bin"), false) ||
+            !is_packed_dataset(test_path("packed.bin")))
+        return -1;
+    Dataset loaded = load_packed_dataset(test_path("packed.bin"), true);
+    if(loaded.getSigmaLength() != item_bits || loaded.getLongDatasetRef() != items ||
+            loaded.getItemStore().size() != items.size())
+        return -1;
+    for(size_t index = 0; index < items.size(); index++)
+        if(loaded.getItemStore()[index] != to_bitstring(items[index], item_bits))
+            return -1;
+
+    // Sorted and deduplicated
+    if(!convert_csv_to_packed(test_path("packed.csv"), test_path("sorted.bin"), true))
+        return -1;
+    vector<uint64_t> sorted = items;
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+    if(load_packed_dataset(test_path("sorted.bin"), false).getLongDatasetRef() != sorted)
+        return -1;
+
+    // A line that is not a bitstring, or lines of different widths, make the conversion fail
+    write_text_file(test_path("bad_row.csv"), "0101\n0110\nabcd\n1111\n");
+    write_text_file(test_path("widths.csv"), "0101\n0110\n111\n");
+    if(convert_csv_to_packed(test_path("bad_row.csv"), test_path("bad_row.bin"), false) ||
+            filesystem::exists(test_path("bad_row.bin")) ||
+            convert_csv_to_packed(test_path("widths.csv"), test_path("widths.bin"), false))
+        return -1;
+
+    // Items wider than the header says are not written, nor loaded
+    if(write_packed_dataset(test_path("wide.bin"), {0x1F}, 4, false) ||
+            !write_packed_dataset(test_path("wide.bin"), {0x1F}, 5, false))
+        return -1;
+    fstream wide(test_path("wide.bin"), ios::in | ios::out | ios::binary);
+    wide.seekp(6);
+    wide.put(4);            // item_bits field
+    wide.close();
+    Dataset rejected = load_packed_dataset(test_path("wide.bin"), false);
+    if(rejected.getSigmaLength() != 0 || rejected.getLongDatasetRef().size() != 0)
+        return -1;
+    return 0;
+}
+
+
+/** Payload of the message `index` of the transport test: its size and bytes depend on the index */
+vector<unsigned char> transport_message(size_t index)
+{
+    vector<unsigned char> message((index * 37) % 1500);
+    for(size_t byte = 0; byte < message.size(); byte++)
+        message[byte] = (unsigned char)(index * 31 + byte);
+    return message;
+}
+
+
+/**
+ * `ShmTransport`: messages of any size cross the ring in order, also when they wrap around its end,
+ * oversized messages are refused, a closed or silent peer makes the waits fail instead of hanging
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_transport()
+{
+    const size_t num_messages = 2000;
+    ShmTransport creator, peer;
+    if(!creator.create(4096) || !peer.attach(creator.getFd()))
+        return -1;
+
+    // The producer fills the ring faster than the consumer releases it, so both sides wait
+    thread producer([&](){
+        for(size_t index = 0; index < num_messages; index++){
+            vector<unsigned char> message = transport_message(index);
+            seal_byte *buffer = creator.begin_send(message.size() + 8);
+            if(buffer == nullptr)
+                return;
+            memcpy(buffer, message.data(), message.size());
+            if(!creator.end_send(message.size()))
+                return;
+        }
+    });
+    int result = 0;
+    for(size_t index = 0; index < num_messages && result == 0; index++){
+        size_t size = 0;
+        const seal_byte *buffer = peer.begin_receive(size);
+        vector<unsigned char> message = transport_message(index);
+        if(buffer == nullptr || size != message.size() || memcmp(buffer, message.data(), size) != 0)
+            result = -1;
+        else
+            peer.end_receive();
+        if(index % 100 == 0)
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    producer.join();
+    if(result != 0)
+        return -1;
+
+    // Messages larger than the ring, or than their reservation, are refused
+    if(creator.begin_send(4096) != nullptr || creator.begin_send(16) == nullptr || creator.end_send(17) ||
+            !creator.end_send(16))
+        return -1;
+    size_t size = 0;
+    if(peer.begin_receive(size) == nullptr || size != 16)
+        return -1;
+    peer.end_receive();
+
+    // Nothing sent, or no room released: the waits give up after the timeout
+    creator.setTimeout(50);
+    peer.setTimeout(50);
+    if(peer.begin_receive(size) != nullptr)
+        return -1;
+    while(creator.begin_send(1000) != nullptr)
+        creator.end_send(1000);
+
+    // A waiting peer is woken up by `close`, after receiving the messages sent before it
+    while(peer.begin_receive(size) != nullptr && size == 1000)
+        peer.end_receive();
+    peer.setTimeout(0);
+    chrono::steady_clock::time_point start_wait = chrono::steady_clock::now();
+    thread closer([&](){
+        this_thread::sleep_for(chrono::milliseconds(20));
+        creator.close();
+    });
+    const seal_byte *after_close = peer.begin_receive(size);
+    closer.join();
+    if(after_close != nullptr || chrono::steady_clock::now() - start_wait > chrono::seconds(5) ||
+            creator.begin_send(8) != nullptr)
+        return -1;
+    return 0;
+}
+
+
+/**
+ * Hashed items: `hash_item` is deterministic, keyed and within the item width, `load_hashed_dataset`
+ * keeps the original strings next to their items (in file order, also when the file is split across
+ * threads), and the service refuses item widths giving too many false matches
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_item_hash()
+{
+    const ItemHashKey key = {0x0123456789ABCDEFULL, 0xFEDCBA9876543210ULL};
+    const ItemHashKey other_key = {0x0123456789ABCDEFULL, 0xFEDCBA9876543211ULL};
+    const string email = "alice@example.com";
+    uint64_t hashed = hash_item(email, key, DEFAULT_ITEM_BITS);
+    if(hashed != hash_item(email.data(), email.size(), key, DEFAULT_ITEM_BITS) || 
+            hashed >> DEFAULT_ITEM_BITS != 0 || hashed == hash_item(email, other_key, DEFAULT_ITEM_BITS) ||
+            hashed == hash_item("alice@example.con", key, DEFAULT_ITEM_BITS) ||
+            hash_item(email, key, 12) >> 12 != 0)
+        return -1;
+
+    // Strings of every length up to a few hash blocks, no collision expected at 40 bits
+    vector<string> strings;
+    for(size_t index = 0; index < 20000; index++)
+        strings.push_back("user" + to_string(index) + string(index % 40, 'x') + "@example.com");
+    vector<uint64_t> values(strings.size());
+    for(size_t index = 0; index < strings.size(); index++)
+        values[index] = hash_item(strings[index], key, DEFAULT_ITEM_BITS);
+    vector<uint64_t> sorted = values;
+    sort(sorted.begin(), sorted.end());
+    if(adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+        return -1;
+
+    // CRLF and LF lines, empty lines and duplicates; the large file is hashed by several threads
+    for(bool large : {false, true}){
+        string content;
+        vector<string> expected;
+        for(size_t index = 0; content.size() < (large ? (3 << 20) : 1000); index++){
+            const string &item = strings[index % strings.size()];
+            content += item + (index % 3 == 0 ? "\r\n" : "\n") + (index % 7 == 0 ? "\n" : "");
+            if(index < strings.size())
+                expected.push_back(item);
+        }
+        write_text_file(test_path("hashed.txt"), content);
+        Dataset dataset = load_hashed_dataset(test_path("hashed.txt"), key, DEFAULT_ITEM_BITS, true);
+        const vector<uint64_t> &loaded = dataset.getLongDatasetRef();
+        const ItemStore &items = dataset.getItemStore();
+        if(dataset.getSigmaLength() != DEFAULT_ITEM_BITS || loaded.size() != expected.size() ||
+                items.size() != expected.size())
+            return -1;
+        size_t index = 0;
+        for(string_view item : items){
+            if(item != expected[index] || loaded[index] != values[index])
+                return -1;
+            index++;
+        }
+    }
+
+    // 20000 sender items against a full query of 8192 items: refused at 24 bits, accepted at 40
+    SenderService service(8192, 4, 1);
+    if(service.load_hashed_dataset(test_path("hashed.txt"), key, make_binning_params(8192, 24)) ||
+            !service.load_hashed_dataset(test_path("hashed.txt"), key, make_binning_params(8192, DEFAULT_ITEM_BITS)))
+        return -1;
+    return 0;
+}
+
+
+/**
+ * `zero_scan`: every kernel supported by the CPU gives the bitmap of the zero slots, for any length
+ * (tails shorter than a vector or a bitmap word included), and writes no word past the last one
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_zero_scan()
+{
+    // Non-zero values with a zero half catch a 64 bit comparison done on 32 bit lanes
+    const uint64_t values[] = {0, 1, 1ULL << 32, 0xFFFFFFFF00000000ULL, 0xFFFFFFFFULL, UINT64_MAX};
+    mt19937_64 generator(11);
+    vector<size_t> lengths;
+    for(size_t count = 0; count <= 260; count++)
+        lengths.push_back(count);
+    lengths.push_back(8191);
+    lengths.push_back(8192);
+
+    for(ZeroScanKernel kernel : {ZeroScanKernel::automatic, ZeroScanKernel::scalar, ZeroScanKernel::sse2, 
+            ZeroScanKernel::avx2}){
+        if(!zero_scan_supported(kernel))
+            continue;
+        for(size_t count : lengths){
+            vector<uint64_t> slots(count);
+            for(uint64_t &slot : slots)
+                slot = values[generator() % 6];
+            size_t num_words = (count + 63) / 64;
+            vector<uint64_t> expected(num_words + 1, 0x5A5A5A5A5A5A5A5AULL), words = expected;
+            for(size_t w = 0; w < num_words; w++)
+                expected[w] = 0;
+            for(size_t i = 0; i < count; i++)
+                expected[i / 64] |= (uint64_t)(slots[i] == 0) << (i % 64);
+
+            zero_scan(slots.data(), count, words.data(), kernel);
+            if(words != expected)
+                return -1;
+        }
+    }
+    return zero_scan_supported(ZeroScanKernel::scalar) ? 0 : -1;
+}
+
+
+/** Items of the service tests: the sender holds the first 100, the receivers 30 of them and 50 others */
+vector<uint64_t> service_items()
+{
+    return gen_rand_items(200, 19, 11);
+}
+
+
+/** Write the sender dataset of the service tests (bitstrings) and return its path */
+string write_service_dataset()
+{
+    vector<uint64_t> items = service_items();
+    string csv;
+    for(size_t index = 0; index < 100; index++)
+        csv += to_bitstring(items[index], 19) + "\n";
+    write_text_file(test_path("service.csv"), csv);
+    return test_path("service.csv");
+}
+
+
+/** Receiver of the service tests, whose dataset shares `SERVICE_MATCHES` items with the sender */
+#define SERVICE_MATCHES 30
+Receiver service_receiver(EncryptionParameters params)
+{
+    vector<uint64_t> items = service_items();
+    vector<uint64_t> recv_items(items.begin(), items.begin() + SERVICE_MATCHES);
+    recv_items.insert(recv_items.end(), items.begin() + 100, items.begin() + 150);
+    ItemStore bitstrings;
+    for(uint64_t item : recv_items)
+        bitstrings.push_back(to_bitstring(item, 19));
+    Dataset dataset;
+    dataset.setSigmaLength(19);
+    dataset.setLongDataset(recv_items);
+    dataset.setItemStore(move(bitstrings));
+    Receiver recv = setup_pk_sk(params);
+    recv.setDataset(move(dataset));
+    return recv;
+}
+
+
+/** Number of matches in the response of the sender to a query of `service_receiver`, -1 if it is empty */
+long service_matches(const Receiver &recv, size_t poly_mod_degree, Ciphertext response)
+{
+    if(response.size() == 0)
+        return -1;
+    return decrypt_and_intersect(poly_mod_degree, move(response), recv).getIntersectionSize();
+}
+
+
+/**
+ * Receiver of the multi-chunk tests: the `SERVICE_MATCHES` items shared with the service sender are spread
+ * over three chunks of 8192 slots, among 20000 items that the sender does not hold
+ * */
+Receiver chunked_receiver(EncryptionParameters params)
+{
+    vector<uint64_t> items = service_items();
+    vector<uint64_t> sender_items(items.begin(), items.begin() + 100);
+    sort(sender_items.begin(), sender_items.end());
+    vector<uint64_t> recv_items;
+    for(uint64_t item : gen_rand_items(20000, 19, 12))
+        if(!binary_search(sender_items.begin(), sender_items.end(), item))
+            recv_items.push_back(item);
+    for(size_t index = 0; index < SERVICE_MATCHES; index++)
+        recv_items.insert(recv_items.begin() + index * 677, items[index]);
+    ItemStore bitstrings;
+    for(uint64_t item : recv_items)
+        bitstrings.push_back(to_bitstring(item, 19));
+    Dataset dataset;
+    dataset.setSigmaLength(19);
+    dataset.setLongDataset(recv_items);
+    dataset.setItemStore(move(bitstrings));
+    Receiver recv = setup_pk_sk(params);
+    recv.setDataset(move(dataset));
+    return recv;
+}
+
+
+/**
+ * `SenderService::stop`: the queries still queued or waiting when the service stops are answered (with
+ * an empty ciphertext if they were not evaluated), the queries submitted afterwards are rejected, and
+ * the service can be started again
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_service_stop()
+{
+    SenderService service(8192, 64, 1);
+    if(!service.load_dataset(write_service_dataset()) || !service.start())
+        return -1;
+    Receiver recv = service_receiver(get_params(8192));
+    Ciphertext query = crypt_dataset(recv, 8192);
+
+    vector<QueryTicket> tickets;
+    for(size_t index = 0; index < 40; index++)
+        tickets.push_back(service.submit(query, recv.getRelinKeys()));
+    service.stop();
+    for(QueryTicket &ticket : tickets){
+        if(ticket.response.wait_for(chrono::seconds(10)) != future_status::ready)
+            return -1;
+        long matches = service_matches(recv, 8192, ticket.response.get());
+        if(matches != -1 && matches != SERVICE_MATCHES)
+            return -1;
+    }
+
+    QueryTicket late = service.submit(query, recv.getRelinKeys());
+    if(late.decision.status != AdmissionStatus::rejected || late.response.get().size() != 0)
+        return -1;
+    if(!service.start() || service_matches(recv, 8192, service.submit(query, recv.getRelinKeys()).response.get()) != 
+            SERVICE_MATCHES)
+        return -1;
+    service.stop();
+    return 0;
+}
+
+
+/**
+ * `KeyCache`: the keys stay under the memory cap by evicting the least recently used ones, lookups move
+ * keys to the front, memory reserved for pinned data evicts keys too, and the counters follow
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_key_cache()
+{
+    EncryptionParameters params = get_params(8192);
+    parms_id_type parms_hash = params.parms_id();
+    RelinKeys relin_keys = setup_pk_sk(params).getRelinKeys();
+    size_t key_bytes = relin_keys.save_size(compr_mode_type::none);
+    KeyCache cache(3 * key_bytes + key_bytes / 2);
+
+    for(string receiver_id : {"r0", "r1", "r2"})
+        cache.insert(receiver_id, params, relin_keys);
+    // r0 becomes the most recently used: inserting r3 evicts r1
+    if(cache.lookup("r0", parms_hash).relin_keys == nullptr || 
+            cache.insert("r3", params, relin_keys).relin_keys == nullptr)
+        return -1;
+    if(!cache.contains("r0", parms_hash) || cache.contains("r1", parms_hash) || 
+            cache.lookup("r1", parms_hash).relin_keys != nullptr || cache.lookup("r2", parms_hash).context == nullptr)
+        return -1;
+    KeyCacheStats stats = cache.getStats();
+    if(stats.hits != 2 || stats.misses != 1 || stats.insertions != 4 || stats.evictions != 1 || 
+            stats.evicted_bytes != key_bytes || stats.entries != 3 || stats.bytes_in_use != 3 * key_bytes)
+        return -1;
+
+    // Keys uploaded serialized are cached like the others, invalid ones are not
+    vector<seal_byte> serialized(key_bytes);
+    relin_keys.save(serialized.data(), serialized.size(), compr_mode_type::none);
+    if(cache.insert("r4", params, serialized.data(), serialized.size()).relin_keys == nullptr ||
+            cache.insert("r5", params, serialized.data(), serialized.size() / 2).relin_keys != nullptr ||
+            cache.contains("r5", parms_hash) || cache.contains("r0", parms_hash))
+        return -1;
+
+    // Reserved memory counts against the cap: it evicts keys, and cannot exceed the cap on its own
+    if(cache.reserve(4 * key_bytes) || !cache.reserve(2 * key_bytes))
+        return -1;
+    stats = cache.getStats();
+    if(stats.entries != 1 || stats.bytes_in_use + stats.bytes_reserved > cache.getMemoryCap() || 
+            !cache.contains("r4", parms_hash))
+        return -1;
+    cache.release(2 * key_bytes);
+    cache.erase("r4", parms_hash);
+    stats = cache.getStats();
+    if(stats.entries != 0 || stats.bytes_in_use != 0 || stats.bytes_reserved != 0)
+        return -1;
+    return 0;
+}
+
+
+/**
+ * Admission control: queries are admitted within the budget, then queued, then rejected with a retry
+ * hint following the observed speed; queries that can never fit are rejected without a hint, also by
+ * the service
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_admission()
+{
+    EncryptionParameters params = get_params(8192);
+    QueryCost cost = estimate_query_cost(params, 100, 1);
+    QueryCost larger_set = estimate_query_cost(params, 1000, 1);
+    if(larger_set.memory_bytes <= cost.memory_bytes || larger_set.cpu_units <= cost.cpu_units)
+        return -1;
+
+    AdmissionBudget budget;
+    budget.memory_bytes = 2 * cost.memory_bytes;
+    budget.cpu_units = 2 * cost.cpu_units;
+    budget.max_waiting = 1;
+    AdmissionController admission(budget, 2);
+    if(admission.try_admit(cost).status != AdmissionStatus::admitted || 
+            admission.try_admit(cost).status != AdmissionStatus::admitted ||
+            admission.try_admit(cost).status != AdmissionStatus::queued)
+        return -1;
+    AdmissionDecision rejected = admission.try_admit(cost);
+    if(rejected.status != AdmissionStatus::rejected || rejected.retry_after.count() <= 0 || 
+            admission.admit_waiting(cost))
+        return -1;
+
+    // 10 ms per query: the hint covers the work in flight and waiting, shared by the two workers
+    admission.release(cost, chrono::milliseconds(10));
+    if(!admission.admit_waiting(cost) || admission.getMemoryInUse() != 2 * cost.memory_bytes)
+        return -1;
+    admission.try_admit(cost);
+    rejected = admission.try_admit(cost);
+    if(rejected.status != AdmissionStatus::rejected || rejected.retry_after < chrono::milliseconds(15) || 
+            rejected.retry_after > chrono::milliseconds(16))
+        return -1;
+
+    // Larger than the budget: rejected at once, even with nothing in flight
+    AdmissionController idle(budget, 2);
+    AdmissionDecision oversized = idle.try_admit(larger_set);
+    if(oversized.status != AdmissionStatus::rejected || oversized.retry_after.count() != 0 || 
+            idle.try_admit(cost).status != AdmissionStatus::admitted)
+        return -1;
+
+    SenderService service(8192, 16, 1, budget);
+    if(!service.load_dataset(write_service_dataset()) || !service.start())
+        return -1;
+    Receiver recv = service_receiver(params);
+    QueryTicket ticket = service.submit(crypt_dataset(recv, 8192), recv.getRelinKeys());
+    if(ticket.decision.status != AdmissionStatus::admitted || 
+            service_matches(recv, 8192, ticket.response.get()) != SERVICE_MATCHES)
+        return -1;
+    service.stop();
+    budget.memory_bytes = cost.memory_bytes - 1;
+    SenderService small_service(8192, 16, 1, budget);
+    if(!small_service.load_dataset(write_service_dataset()) || !small_service.start())
+        return -1;
+    ticket = small_service.submit(crypt_dataset(recv, 8192), recv.getRelinKeys());
+    small_service.stop();
+    if(ticket.decision.status != AdmissionStatus::rejected || ticket.decision.retry_after.count() != 0)
+        return -1;
+    return 0;
+}
+
+
+/**
+ * Query batching: evaluating the queries of several receivers in one pass gives the same results as
+ * evaluating them one by one, and the service answers each receiver of a batch correctly
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_query_batch()
+{
+    EncryptionParameters params = get_params(8192);
+    SEALContext context(params);
+    Evaluator evaluator(context);
+    BatchEncoder encoder(context);
+    vector<uint64_t> items = service_items();
+    vector<Plaintext> sender_values = encode_sender_dataset(vector<uint64_t>(items.begin(), items.begin() + 100), 
+            encoder);
+    vector<shared_ptr<const Plaintext>> sender_plain = share_plaintexts(sender_values);
+    Plaintext rand_plain;
+    encoder.encode(gen_rand_mask(encoder.slot_count(), params.plain_modulus().value()), rand_plain);
+
+    vector<Receiver> receivers;
+    vector<Ciphertext> queries;
+    for(size_t index = 0; index < 3; index++){
+        receivers.push_back(service_receiver(params));
+        queries.push_back(crypt_dataset(receivers.back(), 8192));
+    }
+    vector<const Ciphertext *> recv_cts;
+    vector<const RelinKeys *> relin_keys;
+    for(size_t index = 0; index < receivers.size(); index++){
+        recv_cts.push_back(&queries[index]);
+        relin_keys.push_back(&receivers[index].getRelinKeys());
+    }
+    vector<Ciphertext> batched = evaluate_psi_polynomial_batch(recv_cts, sender_plain, rand_plain, evaluator, 
+            relin_keys, MemoryManager::GetPool());
+    if(batched.size() != receivers.size())
+        return -1;
+    for(size_t index = 0; index < receivers.size(); index++){
+        Ciphertext single = evaluate_psi_polynomial(queries[index], sender_values, rand_plain, evaluator, 
+                receivers[index].getRelinKeys(), MemoryManager::GetPool());
+        if(decrypt_query({batched[index]}, context, receivers[index]) != 
+                decrypt_query({single}, context, receivers[index]))
+            return -1;
+    }
+
+    // A burst of queries on one worker is evaluated in batches
+    SenderService service(8192, 64, 1);
+    service.setMaxBatch(4);
+    if(!service.load_dataset(write_service_dataset()) || !service.start())
+        return -1;
+    vector<QueryTicket> tickets;
+    for(size_t index = 0; index < 2 * receivers.size(); index++)
+        tickets.push_back(service.submit(queries[index % receivers.size()], 
+                receivers[index % receivers.size()].getRelinKeys()));
+    for(size_t index = 0; index < tickets.size(); index++)
+        if(service_matches(receivers[index % receivers.size()], 8192, tickets[index].response.get()) != 
+                SERVICE_MATCHES)
+            return -1;
+    service.stop();
+    return 0;
+}
+
+
+/**
+ * `SenderService::serve_stream`: the chunks of a streamed query that the admission controller rejects
+ * for now are submitted again after the retry hint, so that every chunk is answered; a receiver whose
+ * keys are unknown gets an early end of stream
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_serve_stream()
+{
+    const size_t poly_mod_degree = 8192;
+    EncryptionParameters params = get_params(poly_mod_degree);
+
+    Receiver recv = chunked_receiver(params);
+
+    // One chunk in flight at a time and none waiting: the following chunks are rejected while it runs
+    AdmissionBudget budget;
+    budget.cpu_units = estimate_query_cost(params, 100, 1).cpu_units;
+    budget.max_waiting = 0;
+    SenderService service(poly_mod_degree, 16, 2, budget);
+    if(!service.load_dataset(write_service_dataset()) || !service.start())
+        return -1;
+    vector<seal_byte> keys(recv.getRelinKeys().save_size(compr_mode_type::none));
+    recv.getRelinKeys().save(keys.data(), keys.size(), compr_mode_type::none);
+    if(!service.upload_keys("receiver", params, keys.data(), keys.size()))
+        return -1;
+
+    ShmTransport receiver_side, sender_side;
+    if(!receiver_side.create(4 << 20) || !sender_side.attach(receiver_side.getFd()))
+        return -1;
+    ThreadPool pool(2);
+    for(string receiver_id : {"receiver", "unknown"}){
+        bool served = false;
+        thread serving([&](){ served = service.serve_stream(sender_side, receiver_id, params); });
+        ComputationResult result = stream_query(receiver_side, recv, poly_mod_degree, pool);
+        serving.join();
+        bool known = receiver_id == "receiver";
+        if(served != known || (known && result.getIntersectionSize() != SERVICE_MATCHES))
+            return -1;
+    }
+    service.stop();
+    return 0;
+}
+
+
+/** `stoull(line, 0, 2)` on the first 64 characters of a line, as the original loader did: false if it throws */
+bool reference_bitstring(const string &line, uint64_t &value)
+{
+    try{
+        value = stoull(line.substr(0, 64), 0, 2);
+        return true;
+    }
+    catch(exception &e){
+        return false;
+    }
+}
+
+
+/** Random line of a bitstring dataset: 1 to 70 bits, maybe with leading whitespace, '\r' or trailing characters */
+string random_bitstring_line(mt19937_64 &generator)
+{
+    string line = generator() % 8 == 0 ? (generator() % 2 ? " " : "\t") : "";
+    for(size_t bit = 1 + generator() % 70; bit > 0; bit--)
+        line += '0' + (generator() & 1);
+    if(generator() % 8 == 0)
+        line += " x";
+    if(generator() % 4 == 0)
+        line += '\r';
+    return line;
+}
+
+
+/**
+ * SIMD bitstring kernels: `find_newline`, `pack_bitstring` and the line parser give the same result as
+ * `stoull` for every bitstring length and alignment, with CRLF lines, a missing final newline and
+ * invalid lines
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_bitstring_kernels()
+{
+    mt19937_64 generator(21);
+    string buffer(200, 'a');
+    for(size_t newline = 0; newline <= buffer.size(); newline++){
+        string text = buffer;
+        if(newline < text.size())
+            text[newline] = '\n';
+        for(size_t start = 0; start < 40 && start <= newline; start++)
+            if(find_newline(text.data() + start, text.data() + text.size()) != text.data() + newline)
+                return -1;
+    }
+
+    for(size_t length = 1; length <= 64; length++){
+        for(string suffix : {"", "\n", "\r\n", "x1", "2", " 1", "0000000000000000000"}){
+            string line;
+            for(size_t bit = 0; bit < length; bit++)
+                line += '0' + (generator() & 1);
+            line += suffix;
+            uint64_t expected, value;
+            size_t run = line.find_first_not_of("01");
+            size_t converted = pack_bitstring(line.data(), line.data() + line.size(), 64, value);
+            if(!reference_bitstring(line, expected) || value != expected || 
+                    converted != min((size_t)64, run == string::npos ? line.size() : run))
+                return -1;
+            if(pack_bitstring(line.data(), line.data() + line.size(), length / 2, value) != length / 2 ||
+                    (length >= 2 && value != expected >> (min((size_t)64, converted) - length / 2)))
+                return -1;
+        }
+    }
+
+    // Whole files: every line valid (the last one without newline), then an invalid line in the middle
+    for(bool with_invalid : {false, true}){
+        vector<string> lines;
+        for(size_t index = 0; index < 5000; index++)
+            lines.push_back(random_bitstring_line(generator));
+        if(with_invalid)
+            lines[2500] = generator() % 2 ? "a0101" : " x0101";
+        string text;
+        for(const string &line : lines)
+            text += line + "\n";
+        text.pop_back();
+
+        vector<uint64_t> values;
+        ItemStore items;
+        bool complete = parse_bitstring_file(text.data(), text.size(), values, &items, 1);
+        size_t index = 0;
+        uint64_t expected = 0;
+        for(; index < lines.size() && reference_bitstring(lines[index], expected); index++)
+            if(index >= values.size() || values[index] != expected || items[index] != lines[index].substr(0, 64))
+                return -1;
+        if(complete != (index == lines.size()) || values.size() != index || items.size() != index)
+            return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * `load_dataset`: one pass over the file gives aligned integer and string views, equal to the
+ * separate loaders, deduplication keeps the first occurrences in both views, and a file stopping at an
+ * invalid line is reported as incomplete
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_load_dataset()
+{
+    vector<uint64_t> items = gen_rand_items(3000, 24, 17);
+    items.insert(items.end(), items.begin(), items.begin() + 500);
+    string csv;
+    for(size_t index = 0; index < items.size(); index++)
+        csv += to_bitstring(items[index], 24) + (index % 5 == 1 ? "\r\n" : "\n");
+    write_text_file(test_path("load.csv"), csv);
+
+    bool complete = false;
+    Dataset dataset = load_dataset(test_path("load.csv"), false, &complete);
+    const ItemStore &strings = dataset.getItemStore();
+    ItemStore separate_strings = read_dataset_from_file(test_path("load.csv"));
+    if(!complete || dataset.getLongDatasetRef() != items || 
+            dataset.getLongDatasetRef() != bitstring_to_long_dataset(test_path("load.csv")) ||
+            strings.size() != items.size() || separate_strings.size() != items.size())
+        return -1;
+    for(size_t index = 0; index < items.size(); index++)
+        if(strings[index] != separate_strings[index] || strings[index].substr(0, 24) != to_bitstring(items[index], 24))
+            return -1;
+    if(dataset.getSigmaLength() != 24)
+        return -1;
+
+    Dataset unique = load_dataset(test_path("load.csv"), true, &complete);
+    if(!complete || unique.getLongDatasetRef() != vector<uint64_t>(items.begin(), items.begin() + 3000) ||
+            unique.getItemStore().size() != 3000)
+        return -1;
+    for(size_t index = 0; index < 3000; index++)
+        if(unique.getItemStore()[index] != strings[index])
+            return -1;
+
+    write_text_file(test_path("load_bad.csv"), "0101\n0110\n01x0\n2\n1111\n");
+    Dataset partial = load_dataset(test_path("load_bad.csv"), false, &complete);
+    if(complete || partial.getLongDatasetRef() != vector<uint64_t>({5, 6, 1}) || partial.getItemStore().size() != 3)
+        return -1;
+    load_dataset(test_path("missing.csv"), false, &complete);
+    return complete ? -1 : 0;
+}
+
+
+/**
+ * Parallel parsing: `split_lines` cuts a buffer into contiguous parts starting at line boundaries, and
+ * parsing a file with several threads gives the same values, strings and outcome as with one
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_parallel_parse()
+{
+    mt19937_64 generator(38);
+    string text;
+    while(text.size() < (6 << 20))
+        text += random_bitstring_line(generator) + "\n";
+
+    for(size_t size : {(size_t)0, (size_t)5, (size_t)100, text.size()}){
+        for(size_t num_parts = 1; num_parts <= 16; num_parts++){
+            vector<pair<const char *, const char *>> parts = split_lines(text.data(), size, num_parts);
+            const char *expected_begin = text.data();
+            for(const pair<const char *, const char *> &part : parts){
+                if(part.first != expected_begin || part.second <= part.first || 
+                        (part.first != text.data() && part.first[-1] != '\n'))
+                    return -1;
+                expected_begin = part.second;
+            }
+            if(expected_begin != text.data() + size || parts.size() > num_parts)
+                return -1;
+        }
+    }
+
+    // Valid file, then an invalid line in the part of a later thread
+    for(bool with_invalid : {false, true}){
+        if(with_invalid)
+            text.replace(text.find('\n', 4 << 20) + 1, 1, "z");
+        vector<uint64_t> serial_values, parallel_values;
+        ItemStore serial_items, parallel_items;
+        bool serial = parse_bitstring_file(text.data(), text.size(), serial_values, &serial_items, 1);
+        bool parallel = parse_bitstring_file(text.data(), text.size(), parallel_values, &parallel_items, 8);
+        if(serial != !with_invalid || parallel != serial || parallel_values != serial_values || 
+                parallel_items.size() != serial_items.size() || serial_values.size() < 1000)
+            return -1;
+        for(size_t index = 0; index < serial_items.size(); index++)
+            if(parallel_items[index] != serial_items[index])
+                return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * `ItemStore`: items pushed or appended from another store, empty ones included, are read back in
+ * order by index and by iteration
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_item_store()
+{
+    vector<string> expected = {"0101", "", "1", string(64, '1'), "item with spaces"};
+    ItemStore store;
+    if(store.size() != 0 || store.begin() != store.end())
+        return -1;
+    store.reserve(expected.size(), 100);
+    for(size_t index = 0; index < 3; index++)
+        store.push_back(expected[index]);
+    ItemStore other;
+    for(size_t index = 3; index < expected.size(); index++)
+        other.push_back(expected[index].data(), expected[index].size());
+    store.append(other);
+
+    size_t chars = 0;
+    for(const string &item : expected)
+        chars += item.size();
+    if(store.size() != expected.size() || store.getCharCount() != chars)
+        return -1;
+    size_t index = 0;
+    for(ItemStore::const_iterator it = store.begin(); it != store.end(); it++, index++)
+        if(*it != expected[index] || store[index] != expected[index] || store.getString(index) != expected[index])
+            return -1;
+    if(index != expected.size() || !equal(store.begin(), store.end(), expected.begin()))
+        return -1;
+
+    store.clear();
+    return store.size() == 0 && store.getCharCount() == 0 && store.begin() == store.end() ? 0 : -1;
+}
+
+
+/**
+ * Intersection output: `IntersectionBitmap` keeps the matched positions (across word boundaries), and
+ * `write_intersection` writes their strings in order, also when they exceed its buffer
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_intersection_output()
+{
+    IntersectionBitmap empty(130);
+    if(empty.count() != 0 || empty.first() != 130 || empty.getIndices().size() != 0 || 
+            !write_intersection(empty, ItemStore(), test_path("empty.txt")) || 
+            filesystem::file_size(test_path("empty.txt")) != 0)
+        return -1;
+
+    // Long strings, so that the output goes through several buffer flushes
+    const size_t num_items = 5000;
+    ItemStore items;
+    for(size_t index = 0; index < num_items; index++)
+        items.push_back(to_string(index) + string(index % 100, 'x'));
+    IntersectionBitmap matches(num_items);
+    vector<uint64_t> expected;
+    string expected_text;
+    for(size_t index = 0; index < num_items; index++){
+        if(index % 3 == 0 || index % 64 == 63 || index == num_items - 1){
+            matches.set(index);
+            expected.push_back(index);
+            expected_text += items.getString(index) + "\n";
+        }
+    }
+    if(matches.count() != expected.size() || matches.getIndices() != expected || matches.first() != 0 ||
+            !matches.test(63) || matches.test(64) || matches.size() != num_items)
+        return -1;
+    ItemStore selected = matches.materialize(items);
+    if(selected.size() != expected.size() || selected[1] != items[3])
+        return -1;
+
+    if(!write_intersection(matches, items, test_path("intersection.txt")))
+        return -1;
+    ifstream output(test_path("intersection.txt"), ios::binary);
+    string text((istreambuf_iterator<char>(output)), istreambuf_iterator<char>());
+    return text == expected_text && text.size() > (1 << 16) ? 0 : -1;
+}
+
+
+/** Read a whole dataset with a `DatasetChunkReader`, checking that every chunk but the last one is full */
+bool read_chunks(string path, size_t chunk_size, size_t buffer_size, Dataset &dataset, size_t &num_chunks)
+{
+    DatasetChunkReader reader;
+    if(!reader.open(path, chunk_size, buffer_size))
+        return false;
+    vector<uint64_t> values;
+    ItemStore items;
+    Dataset chunk;
+    bool last = false;
+    for(num_chunks = 0; reader.next_chunk(chunk); num_chunks++){
+        const vector<uint64_t> &chunk_values = chunk.getLongDatasetRef();
+        if(last || chunk_values.size() > chunk_size || chunk.getItemStore().size() != chunk_values.size())
+            return false;
+        last = chunk_values.size() < chunk_size;
+        values.insert(values.end(), chunk_values.begin(), chunk_values.end());
+        items.append(chunk.getItemStore());
+        dataset.setSigmaLength(chunk.getSigmaLength());
+    }
+    dataset.setLongDataset(move(values));
+    dataset.setItemStore(move(items));
+    return !reader.failed() && reader.getItemsRead() == dataset.getLongDatasetRef().size();
+}
+
+
+/**
+ * `DatasetChunkReader`: CSV and packed files larger than a chunk and than the read buffer come out in
+ * full chunks of `slot_count` items, equal to the whole-file loaders; lines longer than the buffer are
+ * truncated as the loaders do, and invalid packed headers are rejected
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_chunk_reader()
+{
+    const size_t slot_count = 8192;
+    const unsigned item_bits = 40;
+    vector<uint64_t> items = gen_rand_items(30000, item_bits, 34);      // 1.2 MB of CSV, 150 KB packed
+    string csv;
+    for(uint64_t item : items)
+        csv += to_bitstring(item, item_bits) + "\n";
+    write_text_file(test_path("chunks.csv"), csv);
+    if(!write_packed_dataset(test_path("chunks.bin"), items, item_bits, false))
+        return -1;
+
+    for(string path : {test_path("chunks.csv"), test_path("chunks.bin")}){
+        for(size_t buffer_size : {(size_t)1 << 20, (size_t)4096}){
+            Dataset dataset;
+            size_t num_chunks = 0;
+            if(!read_chunks(path, slot_count, buffer_size, dataset, num_chunks) || 
+                    num_chunks != (items.size() + slot_count - 1) / slot_count || 
+                    dataset.getLongDatasetRef() != items || dataset.getSigmaLength() != item_bits)
+                return -1;
+            for(size_t index = 0; index < items.size(); index++)
+                if(dataset.getItemStore()[index] != to_bitstring(items[index], item_bits))
+                    return -1;
+        }
+    }
+
+    // A line longer than the buffer
+    string long_line = "0101\n" + string(3000, '1') + string(3000, '0') + "\n0011\n";
+    write_text_file(test_path("long_line.csv"), long_line);
+    Dataset streamed;
+    size_t num_chunks = 0;
+    Dataset loaded = load_dataset(test_path("long_line.csv"));
+    if(!read_chunks(test_path("long_line.csv"), slot_count, 4096, streamed, num_chunks) || num_chunks != 1 ||
+            streamed.getLongDatasetRef() != loaded.getLongDatasetRef() || streamed.getLongDatasetRef().size() != 3 ||
+            streamed.getItemStore()[1] != loaded.getItemStore()[1])
+        return -1;
+
+    // A header announcing more items than the file holds
+    fstream packed(test_path("chunks.bin"), ios::in | ios::out | ios::binary);
+    packed.seekp(8);
+    packed.put(0x7F);           // count: 30079 instead of 30000
+    packed.put(0x75);
+    packed.close();
+    DatasetChunkReader reader;
+    return reader.open(test_path("chunks.bin"), slot_count) ? -1 : 0;
+}
+
+
+/**
+ * Permutation-based hashing: cuckoo hashing places each receiver item once, in one of its candidate bins,
+ * simple hashing places each sender item in all of them, and the item is recovered from its bin and its
+ * stored value, also with items narrower than the bin index
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_cuckoo_hashing()
+{
+    for(unsigned item_bits : {40U, 10U}){
+        BinningParams binning = make_binning_params(8192, item_bits, 7);
+        vector<uint64_t> items = gen_rand_items(item_bits == 10 ? 1000 : 7000, item_bits, 3);
+        if(stored_item_bits(binning) != (item_bits > 13 ? item_bits - 13 : 0) + 2)
+            return -1;
+
+        // A duplicated item is placed once
+        vector<uint64_t> receiver = items;
+        receiver.push_back(items[5]);
+        vector<uint64_t> bin_values;
+        vector<int64_t> bin_items;
+        if(!cuckoo_hash(receiver, binning, bin_values, bin_items))
+            return -1;
+        vector<size_t> placements(receiver.size(), 0);
+        for(size_t bin = 0; bin < binning.num_bins; bin++){
+            if(bin_items[bin] < 0){
+                if(bin_values[bin] != empty_bin_value(binning))
+                    return -1;
+                continue;
+            }
+            uint64_t item = receiver[bin_items[bin]];
+            unsigned hash_index = bin_values[bin] & 3;
+            if(hash_index >= NUM_HASH_FUNCTIONS || bin_index(item, hash_index, binning) != bin ||
+                    bin_values[bin] != stored_value(item, hash_index, binning) ||
+                    bin_values[bin] >= empty_bin_value(binning) || recover_item(bin, bin_values[bin], binning) != item)
+                return -1;
+            placements[bin_items[bin]]++;
+        }
+        for(size_t index = 0; index < items.size(); index++)
+            if(placements[index] != 1)
+                return -1;
+        if(placements.back() != 0)
+            return -1;
+
+        vector<vector<uint64_t>> bins = simple_hash(receiver, binning);
+        for(uint64_t item : items){
+            for(unsigned i = 0; i < NUM_HASH_FUNCTIONS; i++){
+                size_t bin = bin_index(item, i, binning);
+                uint64_t value = stored_value(item, i, binning);
+                if(find(bins[bin].begin(), bins[bin].end(), value) == bins[bin].end() ||
+                        recover_item(bin, value, binning) != item)
+                    return -1;
+            }
+        }
+        for(const vector<uint64_t> &bin : bins)
+            for(uint64_t value : bin)
+                if(count(bin.begin(), bin.end(), value) != 1)
+                    return -1;
+    }
+
+    // More items than bins cannot be placed
+    BinningParams small = make_binning_params(64, 40, 1);
+    vector<uint64_t> bin_values;
+    vector<int64_t> bin_items;
+    if(cuckoo_hash(gen_rand_items(65, 40, 2), small, bin_values, bin_items))
+        return -1;
+    return 0;
+}
+
+
+/**
+ * Deduplication: the first occurrence of every value is kept in its position, whatever the number of
+ * threads, the counts add up, and a dataset keeps the strings of the items kept
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_dedup()
+{
+    // 15% of duplicates, spread over the ranges of the threads
+    mt19937_64 generator(29);
+    vector<uint64_t> values = gen_rand_items(340000, 40, 5);
+    values.push_back(0);
+    values.push_back(UINT64_MAX);
+    size_t num_unique = values.size();
+    for(size_t index = 0; index < 60000; index++)
+        values.push_back(values[generator() % num_unique]);
+    values.push_back(0);
+    values.push_back(UINT64_MAX);
+    shuffle(values.begin(), values.end(), generator);
+
+    vector<char> expected_keep(values.size(), 0);
+    vector<uint64_t> expected;
+    unordered_set<uint64_t> seen;
+    for(size_t index = 0; index < values.size(); index++){
+        if(seen.insert(values[index]).second){
+            expected_keep[index] = 1;
+            expected.push_back(values[index]);
+        }
+    }
+    for(size_t num_threads : {1, 4, 0}){
+        if(mark_first_occurrences(values, num_threads) != expected_keep)
+            return -1;
+        vector<uint64_t> unique = values;
+        DedupStats stats = dedup_values(unique, num_threads);
+        if(unique != expected || stats.input_items != values.size() || stats.unique_items != num_unique ||
+                stats.duplicates != values.size() - num_unique)
+            return -1;
+    }
+    vector<uint64_t> empty;
+    if(dedup_values(empty).input_items != 0 || !mark_first_occurrences(empty).empty())
+        return -1;
+
+    // Duplicated values with different strings: the string of the first occurrence is kept
+    vector<uint64_t> items(values.begin(), values.begin() + 1000);
+    items.insert(items.end(), values.begin(), values.begin() + 200);
+    ItemStore strings;
+    for(size_t index = 0; index < items.size(); index++)
+        strings.push_back(to_bitstring(items[index], 64) + "#" + to_string(index));
+    Dataset dataset;
+    dataset.setLongDataset(items);
+    dataset.setItemStore(strings);
+    DedupStats stats = dedup_dataset(dataset, 2);
+    vector<char> keep = mark_first_occurrences(items, 1);
+    size_t kept = 0;
+    for(size_t index = 0; index < items.size(); index++){
+        if(!keep[index])
+            continue;
+        if(kept >= dataset.getLongDatasetRef().size() || dataset.getLongDatasetRef()[kept] != items[index] ||
+                dataset.getItemStore()[kept] != strings[index])
+            return -1;
+        kept++;
+    }
+    if(kept != dataset.getLongDatasetRef().size() || dataset.getItemStore().size() != kept ||
+            stats.unique_items != kept || stats.duplicates != items.size() - kept || stats.duplicates < 200)
+        return -1;
+
+    // Without strings only the values are deduplicated; a dataset without duplicates is left as is
+    Dataset values_only;
+    values_only.setLongDataset(items);
+    if(dedup_dataset(values_only).unique_items != kept || values_only.getItemStore().size() != 0 ||
+            values_only.getLongDatasetRef() != dataset.getLongDatasetRef())
+        return -1;
+    stats = dedup_dataset(dataset);
+    if(stats.duplicates != 0 || stats.unique_items != kept || dataset.getItemStore().size() != kept)
+        return -1;
+    return 0;
+}
+
+
+/**
+ * `decrypt_and_intersect_chunks`: decrypting the chunks of a response in parallel gives the matches and
+ * the noise budget of decrypting them one by one on the calling thread, and a response with missing or
+ * extra ciphertexts has no matches
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_parallel_decrypt()
+{
+    const size_t poly_mod_degree = 8192;
+    EncryptionParameters params = get_params(poly_mod_degree);
+    SEALContext context(params);
+    Evaluator evaluator(context);
+    BatchEncoder encoder(context);
+    vector<uint64_t> items = service_items();
+    vector<Plaintext> sender_plain = encode_sender_dataset(vector<uint64_t>(items.begin(), items.begin() + 100), 
+            encoder);
+    Plaintext rand_plain;
+    encoder.encode(gen_rand_mask(encoder.slot_count(), params.plain_modulus().value()), rand_plain);
+
+    Receiver recv = chunked_receiver(params);
+    const Dataset &recv_dataset = recv.getDataset();
+    ThreadPool pool(4);
+    vector<Ciphertext> responses;
+    crypt_dataset_chunks(recv, poly_mod_degree, pool, [&](size_t, const Ciphertext &query){
+        responses.push_back(evaluate_psi_polynomial(query, sender_plain, rand_plain, evaluator, recv.getRelinKeys(),
+                MemoryManager::GetPool()));
+        return true;
+    });
+    if(responses.size() != 3)
+        return -1;
+
+    // Serial path: a receiver per chunk, decrypted with `decrypt_and_intersect`
+    vector<uint64_t> expected;
+    size_t lowest_budget = SIZE_MAX;
+    for(size_t chunk = 0; chunk < responses.size(); chunk++){
+        size_t first = chunk * poly_mod_degree;
+        size_t last = min(recv_dataset.getLongDatasetRef().size(), first + poly_mod_degree);
+        Dataset dataset;
+        ItemStore strings;
+        for(size_t index = first; index < last; index++)
+            strings.push_back(recv_dataset.getItemStore()[index]);
+        dataset.setLongDataset(vector<uint64_t>(recv_dataset.getLongDatasetRef().begin() + first, 
+                recv_dataset.getLongDatasetRef().begin() + last));
+        dataset.setItemStore(move(strings));
+        Receiver chunk_recv = recv;
+        chunk_recv.setDataset(move(dataset));
+        ComputationResult result = decrypt_and_intersect(poly_mod_degree, responses[chunk], chunk_recv);
+        for(uint64_t index : result.getMatches().getIndices())
+            expected.push_back(first + index);
+        lowest_budget = min(lowest_budget, result.getNoiseBudget());
+    }
+    if(expected.size() != SERVICE_MATCHES || expected.back() < 2 * poly_mod_degree)
+        return -1;
+
+    for(size_t num_threads : {1, 4}){
+        ThreadPool decrypt_pool(num_threads);
+        ComputationResult result = decrypt_and_intersect_chunks(poly_mod_degree, responses, recv, decrypt_pool);
+        if(result.getMatches().size() != recv_dataset.getLongDatasetRef().size() || 
+                result.getMatches().getIndices() != expected || result.getNoiseBudget() != lowest_budget)
+            return -1;
+    }
+
+    vector<Ciphertext> missing(responses.begin(), responses.end() - 1);
+    vector<Ciphertext> extra = responses;
+    extra.push_back(responses[0]);
+    if(decrypt_and_intersect_chunks(poly_mod_degree, missing, recv, pool).getIntersectionSize() != 0 ||
+            decrypt_and_intersect_chunks(poly_mod_degree, extra, recv, pool).getIntersectionSize() != 0)
+        return -1;
+    return 0;
+}
+
+
+/**
+ * `crypt_dataset_chunks`: encrypting the chunks in parallel gives the ciphertexts of the serial path, handed
+ * to the consumer in chunk order; a consumer refusing a chunk stops the encryption, and its exceptions
+ * reach the caller
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_parallel_encrypt()
+{
+    const size_t poly_mod_degree = 8192;
+    EncryptionParameters params = get_params(poly_mod_degree);
+    SEALContext context(params);
+    Receiver recv = chunked_receiver(params);
+    const vector<uint64_t> &recv_items = recv.getDataset().getLongDatasetRef();
+
+    // Serial path: the dataset file encrypted chunk by chunk while it is read
+    string csv;
+    for(uint64_t item : recv_items)
+        csv += to_bitstring(item, 19) + "\n";
+    write_text_file(test_path("chunked.csv"), csv);
+    vector<Ciphertext> serial;
+    size_t num_chunks = stream_encrypt_dataset(test_path("chunked.csv"), recv, poly_mod_degree, 
+            [&serial](const Ciphertext &ct, const Dataset &){ serial.push_back(ct); });
+    vector<uint64_t> expected = decrypt_query(serial, context, recv);
+    if(num_chunks != 3 || expected.size() != num_chunks * poly_mod_degree || 
+            !equal(recv_items.begin(), recv_items.end(), expected.begin()) ||
+            any_of(expected.begin() + recv_items.size(), expected.end(), [](uint64_t slot){ return slot != 0; }))
+        return -1;
+
+    for(size_t num_threads : {1, 4}){
+        ThreadPool pool(num_threads);
+        vector<Ciphertext> parallel;
+        vector<size_t> order;
+        size_t count = crypt_dataset_chunks(recv, poly_mod_degree, pool, [&](size_t chunk, const Ciphertext &ct){
+            order.push_back(chunk);
+            parallel.push_back(ct);
+            return true;
+        });
+        if(count != num_chunks || order != vector<size_t>({0, 1, 2}) || 
+                decrypt_query(parallel, context, recv) != expected)
+            return -1;
+    }
+
+    ThreadPool pool(4);
+    size_t calls = 0;
+    if(crypt_dataset_chunks(recv, poly_mod_degree, pool, [&calls](size_t chunk, const Ciphertext &){ 
+                calls++; 
+                return chunk == 0; 
+            }) != 1 || calls != 2)
+        return -1;
+    try{
+        crypt_dataset_chunks(recv, poly_mod_degree, pool, [](size_t chunk, const Ciphertext &){
+            if(chunk == 1)
+                throw runtime_error("consumer failed");
+            return true;
+        });
+        return -1;
+    }
+    catch(const runtime_error &){}
+
+    Receiver empty = recv;
+    empty.setDataset(Dataset());
+    return crypt_dataset_chunks(empty, poly_mod_degree, pool, [](size_t, const Ciphertext &){ return true; }) == 0 ? 
+            0 : -1;
+}
+
+
+/** Uncompressed serialization of a key, to compare keys */
+template <typename Key>
+vector<seal_byte> key_bytes(const Key &key)
+{
+    vector<seal_byte> bytes(key.save_size(compr_mode_type::none));
+    key.save(bytes.data(), bytes.size(), compr_mode_type::none);
+    return bytes;
+}
+
+
+/**
+ * Key store: saved keys load back unchanged and decrypt the queries of the original receiver, while files
+ * made for other parameters, of another version or truncated are rejected; `load_or_setup_pk_sk` reuses
+ * the saved keys and replaces a stale file
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_key_store()
+{
+    EncryptionParameters params = get_params(8192);
+    EncryptionParameters other_params = get_params(8192, 24);
+    string path = receiver_keys_path(TEST_DIR, params);
+    if(path == receiver_keys_path(TEST_DIR, other_params) || path.rfind(string(TEST_DIR) + "/", 0) != 0)
+        return -1;
+
+    Receiver recv = service_receiver(params);
+    Receiver loaded;
+    if(load_receiver_keys(path, params, loaded) || !save_receiver_keys(path, params, recv) || 
+            !load_receiver_keys(path, params, loaded))
+        return -1;
+    if(key_bytes(loaded.getRecvSk()) != key_bytes(recv.getRecvSk()) || 
+            key_bytes(loaded.getRecvPk()) != key_bytes(recv.getRecvPk()) ||
+            key_bytes(loaded.getRelinKeys()) != key_bytes(recv.getRelinKeys()))
+        return -1;
+    SEALContext context(params);
+    loaded.setDataset(recv.getDataset());
+    if(decrypt_query({crypt_dataset(recv, 8192)}, context, loaded) != decrypt_query({crypt_dataset(loaded, 8192)}, 
+            context, recv))
+        return -1;
+
+    // Stale files: other parameters, another version, truncated
+    if(load_receiver_keys(path, other_params, loaded))
+        return -1;
+    string content = read_binary_file(path);
+    if(content.size() <= sizeof(KeyFileHeader) + 8)
+        return -1;
+    string other_version = content;
+    other_version[4]++;
+    write_text_file(test_path("keys_version.bin"), other_version);
+    for(size_t size : {(size_t)0, sizeof(KeyFileHeader) - 1, sizeof(KeyFileHeader) + 4, content.size() - 1}){
+        write_text_file(test_path("keys_truncated.bin"), content.substr(0, size));
+        if(load_receiver_keys(test_path("keys_truncated.bin"), params, loaded))
+            return -1;
+    }
+    if(load_receiver_keys(test_path("keys_version.bin"), params, loaded))
+        return -1;
+
+    // The saved keys are reused; a truncated file is replaced by new keys
+    if(key_bytes(load_or_setup_pk_sk(params, TEST_DIR).getRecvSk()) != key_bytes(recv.getRecvSk()))
+        return -1;
+    write_text_file(path, content.substr(0, content.size() / 2));
+    Receiver regenerated = load_or_setup_pk_sk(params, TEST_DIR);
+    if(key_bytes(regenerated.getRecvSk()) == key_bytes(recv.getRecvSk()) || !load_receiver_keys(path, params, loaded) ||
+            key_bytes(loaded.getRecvSk()) != key_bytes(regenerated.getRecvSk()))
+        return -1;
+    return 0;
+}
+
+
+/** Matches of a query of `service_receiver` against a service using the plaintext cache of `cache_dir` */
+long cached_service_matches(string cache_dir, const Receiver &recv)
+{
+    SenderService service(8192, 16, 1);
+    service.setPlainCacheDir(cache_dir);
+    if(!service.load_dataset(write_service_dataset()) || !service.start())
+        return -1;
+    QueryTicket ticket = service.submit(crypt_dataset(recv, 8192), recv.getRelinKeys());
+    long matches = service_matches(recv, 8192, ticket.response.get());
+    service.stop();
+    return matches;
+}
+
+
+/**
+ * Plaintext cache: a sender set saved by the service loads back unchanged and is used by the next service
+ * instead of encoding the dataset; files made for another dataset, other parameters or another version,
+ * and truncated files, are rejected and the service falls back to encoding (and rewrites the file)
+ *
+ * @return  0 in case of success, -1 in case of failure
+ * */
+int test_plain_cache()
+{
+    EncryptionParameters params = get_params(8192);
+    SEALContext context(params);
+    BatchEncoder encoder(context);
+    const string cache_dir = test_path("plain_cache");
+    filesystem::create_directories(cache_dir);
+    Receiver recv = service_receiver(params);
+    if(cached_service_matches(cache_dir, recv) != SERVICE_MATCHES)
+        return -1;
+
+    // One entry, named after the parameters and the fingerprint of the dataset in its header
+    vector<string> entries;
+    for(const filesystem::directory_entry &entry : filesystem::directory_iterator(cache_dir))
+        entries.push_back(entry.path().string());
+    if(entries.size() != 1)
+        return -1;
+    string path = entries[0];
+    string content = read_binary_file(path);
+    if(content.size() <= sizeof(PlainCacheHeader))
+        return -1;
+    uint64_t dataset_hash = get_le((const unsigned char *)content.data(), 48, 8);
+    if(path != sender_plain_cache_path(cache_dir, params, dataset_hash))
+        return -1;
+
+    vector<uint64_t> items = service_items();
+    vector<shared_ptr<const Plaintext>> expected = share_plaintexts(encode_sender_dataset(
+            vector<uint64_t>(items.begin(), items.begin() + 100), encoder));
+    vector<shared_ptr<const Plaintext>> loaded;
+    if(!load_sender_plain(path, context, params, dataset_hash, loaded) || 
+            decode_rows(loaded, encoder) != decode_rows(expected, encoder))
+        return -1;
+    if(load_sender_plain(path, context, params, dataset_hash + 1, loaded) ||
+            load_sender_plain(path, SEALContext(get_params(8192, 24)), get_params(8192, 24), dataset_hash, loaded))
+        return -1;
+    string other_version = content;
+    other_version[4]++;
+    write_text_file(test_path("plain_version.bin"), other_version);
+    if(load_sender_plain(test_path("plain_version.bin"), context, params, dataset_hash, loaded))
+        return -1;
+    for(size_t size : {sizeof(PlainCacheHeader) - 1, sizeof(PlainCacheHeader) + 4, content.size() - 1}){
+        write_text_file(test_path("plain_truncated.bin"), content.substr(0, size));
+        if(load_sender_plain(test_path("plain_truncated.bin"), context, params, dataset_hash, loaded))
+            return -1;
+    }
+
+    // A hit is used as is: an entry encoding other values changes the answer (the receiver holds 50 of them)
+    vector<shared_ptr<const Plaintext>> other = share_plaintexts(encode_sender_dataset(
+            vector<uint64_t>(items.begin() + 100, items.end()), encoder));
+    if(!save_sender_plain(path, params, dataset_hash, other) || cached_service_matches(cache_dir, recv) != 50)
+        return -1;
+
+    // Stale or truncated entries: the dataset is encoded again, and the entry rewritten
+    for(bool truncated : {false, true}){
+        if(truncated)
+            write_text_file(path, content.substr(0, content.size() / 2));
+        else if(!save_sender_plain(path, params, dataset_hash + 1, other))
+            return -1;
+        if(cached_service_matches(cache_dir, recv) != SERVICE_MATCHES || read_binary_file(path) != content)
+            return -1;
+    }
+    return 0;
+}
+
+
+/** Run a test, printing its outcome as `test` does */
+int run_test(string name, int (*test)())
+{
+    int result = test();
+    if(result == 0)
+        cout << "\033[1;32mTest success \033[0m" << name << "\n";
+    else
+        cout << "\033[1;31mTest failed \033[0m" << name << "\n";
+    return result;
+}
+
+
+int main()
+{
+    filesystem::remove_all(TEST_DIR);
+    filesystem::create_directories(TEST_DIR);
+
+    int failures = 0;
+    failures += run_test("sender_bins", test_sender_bins) != 0;
+    failures += run_test("tasks", test_tasks) != 0;
+    failures += run_test("delta_layout", test_delta_layout) != 0;
+    failures += run_test("query_delta", test_query_delta) != 0;
+    failures += run_test("atomic_writers", test_atomic_writers) != 0;
+    failures += run_test("packed_dataset", test_packed_dataset) != 0;
+    failures += run_test("zero_scan", test_zero_scan) != 0;
+    failures += run_test("item_hash", test_item_hash) != 0;
+    failures += run_test("transport", test_transport) != 0;
+    failures += run_test("service_stop", test_service_stop) != 0;
+    failures += run_test("key_cache", test_key_cache) != 0;
+    failures += run_test("admission", test_admission) != 0;
+    failures += run_test("query_batch", test_query_batch) != 0;
+    failures += run_test("serve_stream", test_serve_stream) != 0;
+    failures += run_test("bitstring_kernels", test_bitstring_kernels) != 0;
+    failures += run_test("load_dataset", test_load_dataset) != 0;
+    failures += run_test("parallel_parse", test_parallel_parse) != 0;
+    failures += run_test("item_store", test_item_store) != 0;
+    failures += run_test("intersection_output", test_intersection_output) != 0;
+    failures += run_test("chunk_reader", test_chunk_reader) != 0;
+    failures += run_test("cuckoo_hashing", test_cuckoo_hashing) != 0;
+    failures += run_test("dedup", test_dedup) != 0;
+    failures += run_test("parallel_decrypt", test_parallel_decrypt) != 0;
+    failures += run_test("parallel_encrypt", test_parallel_encrypt) != 0;
+    failures += run_test("key_store", test_key_store) != 0;
+    failures += run_test("plain_cache", test_plain_cache) != 0;
+
+    filesystem::remove_all(TEST_DIR);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,31 @@
+/** Offline converter from bitstring CSV datasets to the packed binary format (see packed_dataset.h) */
+
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "../lib/packed_dataset.h"
+
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3){
+        printf("Usage:\n1) prog\n2) path of the CSV dataset\n3) path of the packed output\n4) --sort-dedup (optional)\n");
+        return 1;
+    }
+
+    string csv_path = argv[1];
+    string packed_path = argv[2];
+    bool sort_dedup = argc > 3 && strcmp(argv[3], "--sort-dedup") == 0;
+
+    if(!convert_csv_to_packed(csv_path, packed_path, sort_dedup)){
+        cout << "Conversion of " << csv_path << " failed" << endl;
+        return 1;
+    }
+
+    Dataset packed = load_packed_dataset(packed_path, false);
+    cout << "Wrote " << packed.getLongDatasetRef().size() << " items of " << packed.getSigmaLength() 
+        << " bits to " << packed_path << endl;
+    return 0;
+}
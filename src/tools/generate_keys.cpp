@@ -0,0 +1,67 @@
+/** Offline generation of the receiver keys (see key_store.h), so that queries only load them */
+
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../lib/hashing.h"
+#include "../lib/key_store.h"
+#include "../lib/receiver.h"
+
+#define MIN_POLY_MOD_DEGREE 1024
+#define MAX_POLY_MOD_DEGREE 32768
+#define MAX_PLAIN_BITS 60
+
+
+/**
+ * Parse a decimal argument
+ *
+ * @param arg       The argument
+ * @param min_value Smallest accepted value
+ * @param max_value Largest accepted value
+ * @param value     Output, the value
+ *
+ * @return          false if the argument is not a number in [min_value, max_value]
+ * */
+static bool parse_arg(const char *arg, long min_value, long max_value, long &value)
+{
+    char *end;
+    errno = 0;
+    value = strtol(arg, &end, 10);
+    return errno == 0 && end != arg && *end == '\0' && value >= min_value && value <= max_value;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3){
+        printf("Usage:\n1) prog\n2) poly modulus degree (e.g. 8192)\n3) directory of the key files\n"
+                "4) plain modulus bits (optional, e.g. `binning_plain_bits` for binned queries)\n");
+        return 1;
+    }
+
+    long poly_mod_degree, plain_bits = 20;
+    if(!parse_arg(argv[1], MIN_POLY_MOD_DEGREE, MAX_POLY_MOD_DEGREE, poly_mod_degree) || 
+            (poly_mod_degree & (poly_mod_degree - 1)) != 0){
+        printf("The poly modulus degree must be a power of two between %d and %d\n", MIN_POLY_MOD_DEGREE, 
+                MAX_POLY_MOD_DEGREE);
+        return 1;
+    }
+    if(argc > 3 && !parse_arg(argv[3], MIN_PLAIN_BITS, MAX_PLAIN_BITS, plain_bits)){
+        printf("The plain modulus bits must be between %d and %d\n", MIN_PLAIN_BITS, MAX_PLAIN_BITS);
+        return 1;
+    }
+    string key_dir = argv[2];
+    EncryptionParameters params = get_params(poly_mod_degree, plain_bits);
+
+    Receiver recv = setup_pk_sk(params);
+    string path = receiver_keys_path(key_dir, params);
+    if(!save_receiver_keys(path, params, recv)){
+        cout << "Cannot write the keys to " << path << endl;
+        return 1;
+    }
+    cout << "Wrote the receiver keys for degree " << poly_mod_degree << " to " << path << endl;
+    return 0;
+}